@@ -19,8 +19,10 @@
 // #defines
 #define DBG_PRINT 0
 #define MAXLINEPROMPT 20
-#define MAXTOK 5
+#define MAXTOK 8
 #define MAXWLEN 20
+#define TOSCALED_DIGITS 12 // significant digits kept when parsing a number
+#define TOSCALED_LIMIT (1LL << 40) // parsed numbers beyond this are out of range
 
 #ifdef LINUX
 #define PRINTF printw
@@ -53,9 +55,10 @@ typedef struct token_s
 const char default_line_prompt[]="$ ";
 const char* const general[]={"exit", "help", "?", "history", ""};
 const char* const time_suffix[]={"sec", "msec", ""};
-const char* const top_menu[]={"fwd", "back", "left", "right", "pu", "pd", "servo", "m3", "m4", "ext", "admin", "m2m", ""};
+const char* const top_menu[]={"fwd", "back", "left", "right", "pu", "pd", "servo", "m3", "m4", "ext", "admin", "m2m", "arc", "goto", "pos", "coils", "jog", "stop", "abort", "pause", "resume", "move", "speed", ""};
 const char* const admin_menu[]={"cmd1", "cmd2", ""};
-const char* const m2m_menu[]={"fwd", "back", "left", "right", "pu", "pd", "servo", "m3", "m4", "ext", ""};
+const char* const m2m_menu[]={"fwd", "back", "left", "right", "pu", "pd", "servo", "m3", "m4", "ext", "arc", "goto", "pos", "coils", "jog", "stop", "abort", "pause", "resume", "move", "speed", ""};
+const char* const feed_cmds[]={"fwd", "back", "left", "right", "arc", "m3", "m4", "goto", "move", ""}; // moves that can end with @<rpm>
 
 const char* const general_help[]={  " - exit a sub-menu",
                                     " - get help",
@@ -67,12 +70,23 @@ const char* const top_help[]={      "<n>  - go forward n steps",
                                     "<n> - turn right n degrees",
                                     " - lift pen up",
                                     " - set pen down",
-                                    "<n> - move servo to n degrees",
+                                    "[id] <n> - move servo id (0 is the pen) to n degrees, or [id] pulse <us>, range <min us> <max us>, settle <deg> <ms>, slew <deg/s> to calibrate it",
                                     "<n> <dir> - rotate m3 n steps cw/ccw",
                                     "<n> <dir> - rotate m4 n steps cw/ccw",
                                     "<on/off> - external power",
                                     " - admin menu",
                                     " - M2M mode",
+                                    "<r> <n> - drive an arc of radius r steps, n degrees (+ve is left)",
+                                    "<m3/m4> <n> - move m3 or m4 to absolute position n steps, or <x> <y> - turn and drive the wheels to x, y steps from the start",
+                                    "<m3/m4/wheels> - report the position of m3 or m4, or the x, y and heading of the wheels",
+                                    " - report how long the coils of each axis have been energized",
+                                    "<l> <r> - drive the left and right wheels at l and r rpm (+ve is fwd), repeat to keep moving",
+                                    " - decelerate all motors to a stop, drop the queued moves and end the program",
+                                    " - stop all motors at once, drop the queued moves and end the program",
+                                    " - decelerate all motors to a stop and pause the program",
+                                    " - continue the moves and the program after a pause",
+                                    "<wheels/m3/m4> <n> until <ext/button> <rise/fall> - move up to n steps, stop at once on the edge and report the position",
+                                    "<wheels/m3/m4> <rpm> - set the speed of an axis once its moves are done, end a move with @<rpm> to run it slower",
                                     ""};
 const char* const admin_help[]={    " - placeholder command 1",
                                     " - placeholder command 2", 
@@ -83,10 +97,21 @@ const char* const m2m_help[]={      "<n>  - go forward n steps",
                                     "<n> - turn right n degrees",
                                     " - lift pen up",
                                     " - set pen down",
-                                    "<n> - move servo to n degrees",
+                                    "[id] <n> - move servo id (0 is the pen) to n degrees, or [id] pulse <us>, range <min us> <max us>, settle <deg> <ms>, slew <deg/s> to calibrate it",
                                     "<n> <dir> - rotate m3 n steps cw/ccw",
                                     "<n> <dir> - rotate m4 n steps cw/ccw",
                                     "<on/off> - external power",
+                                    "<r> <n> - drive an arc of radius r steps, n degrees (+ve is left)",
+                                    "<m3/m4> <n> - move m3 or m4 to absolute position n steps, or <x> <y> - turn and drive the wheels to x, y steps from the start",
+                                    "<m3/m4/wheels> - report the position of m3 or m4, or the x, y and heading of the wheels",
+                                    " - report how long the coils of each axis have been energized",
+                                    "<l> <r> - drive the left and right wheels at l and r rpm (+ve is fwd), repeat to keep moving",
+                                    " - decelerate all motors to a stop, drop the queued moves and end the program",
+                                    " - stop all motors at once, drop the queued moves and end the program",
+                                    " - decelerate all motors to a stop and pause the program",
+                                    " - continue the moves and the program after a pause",
+                                    "<wheels/m3/m4> <n> until <ext/button> <rise/fall> - move up to n steps, stop at once on the edge and report the position",
+                                    "<wheels/m3/m4> <rpm> - set the speed of an axis once its moves are done, end a move with @<rpm> to run it slower",
                                     ""};
 
 
@@ -103,12 +128,19 @@ char numtok=0;
 char menulevel=MENU_TOP;
 char** cmdlist;
 char** helplist;
+// program fed to the parser from the interface alarm, so the parser has a single caller
+const char* const* prog_lines;
+volatile int prog_idx=0;
+volatile char prog_active=0;
+volatile char prog_paused=0;
+char num_error=0; // set when a number has an unknown suffix or a @ feed is not a speed, the request is rejected
 
 // externs
 extern char usb_control;
 
 // function prototypes
 void split(char* instring, char delim);
+void halt_command(char op);
 
 // functions
 
@@ -269,88 +301,252 @@ int searchfor(char* instring, char** arrp, int* idx, int* parkw)
     return(si);
 }
 
-// very basic sanity checking. It is not bullet-proof
-int
-idx_notanum(char *ts)
+// toscaled: parse a number such as 12, -0.5, 2k or 1.5M (k and M multiply by 1000 and 1000000,
+// m divides by 1000) and return it multiplied by scale and rounded to the nearest integer.
+// It is integer only, so the soft floating point library is not needed. Returns 0 if there is no digit.
+// Any other suffix (such as the p, n, u and G of the old floating point parser) sets num_error.
+int64_t toscaled(char* ds, int64_t scale)
 {
     int i=0;
-    int found=0;
-    
-    while(ts[i]!='\0') {
-        if(ts[i]>='0' && ts[i]<='9') {
-            i++;
-            continue;
+    int neg=0;
+    int digits=0;
+    int big=0;
+    int fdigits=-1; // digits after the decimal point, -1 before it
+    int64_t man=0;
+    int64_t mult=1;
+    int64_t num;
+    int64_t den=1;
+
+    if (ds[i]=='-')
+    {
+        neg=1;
+        i++;
+    }
+    while (((ds[i]>='0') && (ds[i]<='9')) || ((ds[i]=='.') && (fdigits<0)))
+    {
+        if (ds[i]=='.')
+        {
+            fdigits=0;
         }
-        if (ts[i]=='.') {
-            i++;
-            continue;
+        else if (digits<TOSCALED_DIGITS)
+        {
+            man=man*10+(ds[i]-'0');
+            digits++;
+            if (fdigits>=0)
+            {
+                den=den*10;
+            }
         }
-        if (ts[i]=='-') {
-            i++;
-            continue;
+        else if (fdigits<0)
+        {
+            big=1; // too many whole digits, out of range
         }
-        found=1;
-        break;
+        i++;
+    }
+    if (digits==0) // we need at least one digit!
+        return(0);
+    switch(ds[i])
+    {
+        case 'k':
+            mult=1000;
+            i++;
+            break;
+        case 'M':
+            mult=1000000;
+            i++;
+            break;
+        case 'm':
+            den=den*1000;
+            i++;
+            break;
+        default:
+            break;
+    }
+    if (ds[i]!='\0')
+        num_error=1;
+    if (big || (man>TOSCALED_LIMIT/(scale*mult)))
+    {
+        num=TOSCALED_LIMIT; // clamp64() limits it to the int32_t range
     }
-    if(ts[i]==' ')
-        return(-1);
-    if (found)
-        return i;
     else
+    {
+        num=(man*scale*mult+den/2)/den;
+    }
+    return(neg ? 0-num : num);
+}
+
+// clamp64: limit a parsed value to the range of int32_t
+int32_t clamp64(int64_t v)
+{
+    if (v>INT32_MAX)
+        return(INT32_MAX);
+    if (v<INT32_MIN)
+        return(INT32_MIN);
+    return((int32_t)v);
+}
+
+// toint: parse a number (see toscaled) to the nearest integer, e.g. steps
+int32_t toint(char* ds)
+{
+    return(clamp64(toscaled(ds, 1)));
+}
+
+// tomilli: parse a number (see toscaled) in thousandths, e.g. milli-degrees or thousandths of an rpm
+int32_t tomilli(char* ds)
+{
+    return(clamp64(toscaled(ds, 1000)));
+}
+
+// milli_str: format a value in thousandths as a decimal number in buf (at least 16 chars), returns buf
+char* milli_str(int32_t v, char* buf)
+{
+    int64_t a=v;
+
+    if (a<0)
+        a=0-a;
+    sprintf(buf, "%s%ld.%03ld", (v<0) ? "-" : "", (long)(a/1000), (long)(a%1000));
+    return(buf);
+}
+
+// motor_token: returns ROT_M3 or ROT_M4 if the string is "m3" or "m4", otherwise 0
+char motor_token(char* ts)
+{
+    if (strcmp(ts, "m3")==0)
+        return(ROT_M3);
+    if (strcmp(ts, "m4")==0)
+        return(ROT_M4);
+    return(0);
+}
+
+// axis_token: returns SEL_WHEELS, SEL_M3 or SEL_M4 for "wheels", "m3" or "m4", otherwise 0
+char axis_token(char* ts)
+{
+    if (strcmp(ts, "wheels")==0)
+        return(SEL_WHEELS);
+    if (strcmp(ts, "m3")==0)
+        return(SEL_M3);
+    if (strcmp(ts, "m4")==0)
+        return(SEL_M4);
+    return(0);
+}
+
+// trigger_token: returns TRIG_EXT or TRIG_BUTTON combined with TRIG_RISE or TRIG_FALL, otherwise 0
+int trigger_token(char* pin, char* edge)
+{
+    int trig;
+
+    if (strcmp(pin, "ext")==0)
+        trig=TRIG_EXT;
+    else if (strcmp(pin, "button")==0)
+        trig=TRIG_BUTTON;
+    else
+        return(0);
+    if (strcmp(edge, "rise")==0)
+        return(trig | TRIG_RISE);
+    if (strcmp(edge, "fall")==0)
+        return(trig | TRIG_FALL);
+    return(0);
+}
+
+// feed_cmd: returns 1 if the command (the first token) is a move that accepts an @<rpm> feed, otherwise 0
+int feed_cmd(void)
+{
+    int k;
+
+    for (k=0; feed_cmds[k][0]!='\0'; k++)
+    {
+        if ((strlen(feed_cmds[k])==(size_t)tokens[0].len) && (strncmp(&rxbuf[tokens[0].idx], feed_cmds[k], tokens[0].len)==0))
+            return(1);
+    }
+    return(0);
+}
+
+// index_token: returns the value of a whole number of up to 4 digits with no sign, point or suffix, e.g. a
+// servo id, otherwise -1
+int index_token(char* ts)
+{
+    int i=0;
+    int v=0;
+
+    if (ts[0]=='\0')
         return(-1);
+    while (ts[i]!='\0')
+    {
+        if ((ts[i]<'0') || (ts[i]>'9') || (i>=4))
+            return(-1);
+        v=v*10+(ts[i]-'0');
+        i++;
+    }
+    return(v);
 }
 
-double todouble(char* ds)
+// servo_token: returns SERVO_PULSE, SERVO_RANGE, SERVO_SETTLE or SERVO_SLEW for "pulse", "range", "settle"
+// or "slew", otherwise 0
+char servo_token(char* ts)
 {
-    int i;
-    char tc;
-    double mult=1.0;
-    double val_double;
-    char wbuf[MAXWLEN+2];
-    
-    i=idx_notanum(ds);
-    if (i==0) // we need at least one digit!
-        return(0.0);
-        
-    strcpy(wbuf, ds);
-    if (i>0) // there were characters on the end of the number
+    if (strcmp(ts, "pulse")==0)
+        return(SERVO_PULSE);
+    if (strcmp(ts, "range")==0)
+        return(SERVO_RANGE);
+    if (strcmp(ts, "settle")==0)
+        return(SERVO_SETTLE);
+    if (strcmp(ts, "slew")==0)
+        return(SERVO_SLEW);
+    return(0);
+}
+
+// parse_servo: fill in a servo request from the parameters of the servo command, an angle or one of the
+// calibration settings, optionally after a servo id (0 if there is none), returns 0 if they are not valid
+int parse_servo(ui_cmd_t* cmd, char numparam)
+{
+    int b=1; // token of the first parameter after the id
+    int id=0;
+    char op;
+
+    if ((numparam>=2) && !servo_token(&rxbuf[tokens[1].idx]))
     {
-        tc=wbuf[i];
-        wbuf[i]='\0';
+        id=index_token(&rxbuf[tokens[1].idx]);
+        if ((id<0) || (id>SERVO_ID_MAX))
+            return(0); // not a servo id, the request is rejected
+        b=2;
+        numparam--;
     }
-    sscanf(wbuf, "%lf", &val_double);
-    if (i<0)
+    op=servo_token(&rxbuf[tokens[b].idx]);
+    if ((numparam==1) && (op==0))
     {
-        return(val_double); 
+        cmd->value=toint(&rxbuf[tokens[b].idx]);
     }
-    // process the character after the number
-    wbuf[i]=tc;
-    switch(tc)
+    else if ((numparam==2) && ((op==SERVO_PULSE) || (op==SERVO_SLEW)))
     {
-        case 'p':
-            val_double=val_double*1.0E-12;
-            break;
-        case 'n':
-            val_double=val_double*1.0E-9;
-            break;
-        case 'u':
-            val_double=val_double*1.0E-6;
-            break;
-        case 'm':
-            val_double=val_double*1.0E-3;
-            break;
-        case 'k':
-            val_double=val_double*1.0E3;
-            break;
-        case 'M':
-            val_double=val_double*1.0E6;
-            break;
-        case 'G':
-            val_double=val_double*1.0E9;
-            break;
+        cmd->value=toint(&rxbuf[tokens[b+1].idx]);
     }
-    
-    return(val_double);
+    else if ((numparam==3) && ((op==SERVO_RANGE) || (op==SERVO_SETTLE)))
+    {
+        cmd->value=toint(&rxbuf[tokens[b+1].idx]);
+        cmd->value2=toint(&rxbuf[tokens[b+2].idx]);
+    }
+    else
+    {
+        return(0);
+    }
+    cmd->sub_action=op | (id << SERVO_ID_SHIFT);
+    cmd->action=ACTION_SERVO;
+    return(1);
+}
+
+// parse_until: fill in a move until trigger request from the parameters of the move command,
+// returns 0 if they are not valid
+int parse_until(ui_cmd_t* cmd, char numparam)
+{
+    if ((numparam!=5) || (strcmp(&rxbuf[tokens[3].idx], "until")!=0))
+        return(0);
+    cmd->sub_action = axis_token(&rxbuf[tokens[1].idx]);
+    cmd->value = toint(&rxbuf[tokens[2].idx]);
+    cmd->value2 = trigger_token(&rxbuf[tokens[4].idx], &rxbuf[tokens[5].idx]);
+    if ((cmd->sub_action==0) || (cmd->value2==0))
+        return(0);
+    cmd->action=ACTION_UNTIL;
+    return(1);
 }
 
 void
@@ -504,6 +700,8 @@ void split(char* instring, char delim)
         tokens[ctr].idx = ti;
         tokens[ctr].len = i-ti;
         ctr++;
+        if (ctr>=MAXTOK) // any more tokens are ignored
+            break;
         i=ignore_delim(instring, delim, i);
         ti=i;
     }
@@ -546,10 +744,18 @@ void parse_input(void)
     int kw;
     int parkw;
     char tstring[MAXLINEPROMPT+1];
-    double dvar;
+    char nbuf[16];
+    int32_t nvar;
     char numparam;
+    ui_cmd_t cmd;
     // do a carriage return
     PRINTF("\n\r");
+    cmd.action = ACTION_IDLE;
+    cmd.sub_action = 0;
+    cmd.value = 0;
+    cmd.value2 = 0;
+    cmd.feed = 0;
+    num_error = 0;
 
   // build array of token indexes
   split(rxbuf, ' ');
@@ -557,6 +763,15 @@ void parse_input(void)
   {
     if (DBG_PRINT) PRINTF("token %d at index %d, length %d\n\r", i, tokens[i].idx, tokens[i].len);
   }
+  // a move can end with @<rpm> to set its speed, e.g. fwd 2k @300
+  if ((numtok>1) && (rxbuf[tokens[numtok-1].idx]=='@') && feed_cmd())
+  {
+    rxbuf[tokens[numtok-1].idx+tokens[numtok-1].len]='\0';
+    cmd.feed = tomilli(&rxbuf[tokens[numtok-1].idx+1]);
+    if (cmd.feed<=0)
+        num_error=1; // no digits, e.g. "@" or "@fast", or not a speed
+    numtok--;
+  }
   numparam=numtok-1;
   // search for general keywords
   kw=searchfor(rxbuf, (char**)general, &i, &parkw);
@@ -611,12 +826,12 @@ void parse_input(void)
                     if (numparam==1)
                     {
                         //rxbuf[tokens[1].idx+tokens[1].len]='\0';
-                        uiparam_wheelsaction = PAIR_FWD;
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
-                        PRINTF("forward %lf steps\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_WHEELS;
-                        modechange=1;
+                        cmd.sub_action = PAIR_FWD;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
+                        PRINTF("forward %ld steps\n\r", (long)cmd.value);
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -626,12 +841,12 @@ void parse_input(void)
                 case 1: // back
                     if (numparam==1)
                     {
-                        uiparam_wheelsaction = PAIR_REV;
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
-                        PRINTF("back %lf steps\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_WHEELS;
-                        modechange=1;
+                        cmd.sub_action = PAIR_REV;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
+                        PRINTF("back %ld steps\n\r", (long)cmd.value);
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -641,12 +856,12 @@ void parse_input(void)
                 case 2: // left
                     if (numparam==1)
                     {
-                        uiparam_wheelsaction = PAIR_LEFT;
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
-                        PRINTF("left %lf degrees\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_WHEELS;
-                        modechange=1;
+                        cmd.sub_action = PAIR_LEFT;
+                        cmd.value = tomilli(&rxbuf[tokens[1].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
+                        PRINTF("left %s degrees\n\r", milli_str(cmd.value, nbuf));
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -656,12 +871,12 @@ void parse_input(void)
                 case 3: // right
                     if (numparam==1)
                     {
-                        uiparam_wheelsaction = PAIR_RIGHT;
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
-                        PRINTF("right %lf degrees\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_WHEELS;
-                        modechange=1;
+                        cmd.sub_action = PAIR_RIGHT;
+                        cmd.value = tomilli(&rxbuf[tokens[1].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
+                        PRINTF("right %s degrees\n\r", milli_str(cmd.value, nbuf));
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -669,25 +884,26 @@ void parse_input(void)
                     }
                     break;
                 case 4: // pu
-                    uiparam_valueparam = PU_ANG;
-                    PRINTF("pen up %lf degrees\n\r", uiparam_valueparam);
-                    uiparam_doaction=ACTION_SERVO;
-                    modechange=1;
+                    cmd.value = PU_ANG;
+                    PRINTF("pen up %ld degrees\n\r", (long)cmd.value);
+                    cmd.action=ACTION_SERVO;
+                    queue_request(&cmd);
                     break;
                 case 5: // pd
-                    uiparam_valueparam = PD_ANG;
-                    PRINTF("pen down %lf degrees\n\r", uiparam_valueparam);
-                    uiparam_doaction=ACTION_SERVO;
-                    modechange=1;
+                    cmd.value = PD_ANG;
+                    PRINTF("pen down %ld degrees\n\r", (long)cmd.value);
+                    cmd.action=ACTION_SERVO;
+                    queue_request(&cmd);
                     break;
                 case 6: // servo
-                    if (numparam==1)
+                    if (parse_servo(&cmd, numparam))
                     {
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
-                        PRINTF("servo %lf degrees\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_SERVO;
-                        modechange=1;
+                        if (DBG_PRINT) PRINTF("params are %ld %ld\n\r", (long)cmd.value, (long)cmd.value2);
+                        if ((cmd.sub_action & SERVO_OP_MASK)==SERVO_ANG)
+                            PRINTF("servo %d %ld degrees\n\r", cmd.sub_action >> SERVO_ID_SHIFT, (long)cmd.value);
+                        else
+                            PRINTF("servo %d calibration\n\r", cmd.sub_action >> SERVO_ID_SHIFT);
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -697,19 +913,19 @@ void parse_input(void)
                 case 7: // m3
                     if (numparam>=1)
                     {
-                        uiparam_motoraction = ROT_M3;
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
+                        cmd.sub_action = ROT_M3;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
                         if (numparam>=2) {
                             if (strcmp(&rxbuf[tokens[2].idx], "cw") == 0) {
                                 // no change
                             } else if (strcmp(&rxbuf[tokens[2].idx], "ccw") == 0) {
-                                uiparam_valueparam = 0 - uiparam_valueparam;
+                                cmd.value = 0 - cmd.value;
                             }
                         }
-                        PRINTF("rotate m3 %lf steps\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_MOTOR;
-                        modechange=1;
+                        PRINTF("rotate m3 %ld steps\n\r", (long)cmd.value);
+                        cmd.action=ACTION_MOTOR;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -719,19 +935,19 @@ void parse_input(void)
                 case 8: // m4
                     if (numparam>=1)
                     {
-                        uiparam_motoraction = ROT_M4;
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
+                        cmd.sub_action = ROT_M4;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
                         if (numparam>=2) {
                             if (strcmp(&rxbuf[tokens[2].idx], "cw") == 0) {
                                 // no change
                             } else if (strcmp(&rxbuf[tokens[2].idx], "ccw") == 0) {
-                                uiparam_valueparam = 0 - uiparam_valueparam;
+                                cmd.value = 0 - cmd.value;
                             }
                         }
-                        PRINTF("rotate m4 %lf steps\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_MOTOR;
-                        modechange=1;
+                        PRINTF("rotate m4 %ld steps\n\r", (long)cmd.value);
+                        cmd.action=ACTION_MOTOR;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -741,17 +957,17 @@ void parse_input(void)
                 case 9: // ext
                     if (numparam==1)
                     {
-                        uiparam_extaction = EXT_OFF;
+                        cmd.sub_action = EXT_OFF;
                         if ((tokens[1].len==2) && strcmp(&rxbuf[tokens[1].idx], "on")==0) {
-                            uiparam_extaction = EXT_ON;
+                            cmd.sub_action = EXT_ON;
                             PRINTF("external power on\n\r");
                         }
                         else if ((tokens[1].len==3) && strcmp(&rxbuf[tokens[1].idx], "off")==0) {
-                            uiparam_extaction = EXT_OFF;
+                            cmd.sub_action = EXT_OFF;
                             PRINTF("external power off\n\r");
                         }
-                        uiparam_doaction=ACTION_EXT;
-                        modechange=1;
+                        cmd.action=ACTION_EXT;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -766,6 +982,122 @@ void parse_input(void)
                     PRINTF("Entering M2M mode, type exit to quit\n\r");
                     set_menu(MENU_M2M);
                     break;
+                case 12: // arc
+                    if (numparam==2)
+                    {
+                        cmd.sub_action = PAIR_ARC;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        cmd.value2 = tomilli(&rxbuf[tokens[2].idx]);
+                        if (DBG_PRINT) PRINTF("params are %ld %ld\n\r", (long)cmd.value, (long)cmd.value2);
+                        PRINTF("arc radius %ld steps, %s degrees\n\r", (long)cmd.value, milli_str(cmd.value2, nbuf));
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        PRINTF("Error, required parameters %s\n\r", top_help[kw]);
+                    }
+                    break;
+                case 13: // goto
+                    if ((numparam==2) && motor_token(&rxbuf[tokens[1].idx]))
+                    {
+                        cmd.sub_action = (motor_token(&rxbuf[tokens[1].idx])==ROT_M3) ? GOTO_M3 : GOTO_M4;
+                        cmd.value = toint(&rxbuf[tokens[2].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
+                        PRINTF("goto %s %ld\n\r", &rxbuf[tokens[1].idx], (long)cmd.value);
+                        cmd.action=ACTION_MOTOR;
+                        queue_request(&cmd);
+                    }
+                    else if (numparam==2)
+                    {
+                        cmd.sub_action = PAIR_GOTO;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        cmd.value2 = toint(&rxbuf[tokens[2].idx]);
+                        if (DBG_PRINT) PRINTF("params are %ld %ld\n\r", (long)cmd.value, (long)cmd.value2);
+                        PRINTF("goto %ld %ld\n\r", (long)cmd.value, (long)cmd.value2);
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        PRINTF("Error, required parameters %s\n\r", top_help[kw]);
+                    }
+                    break;
+                case 14: // pos
+                    if ((numparam==1) && motor_token(&rxbuf[tokens[1].idx]))
+                    {
+                        cmd.sub_action = motor_token(&rxbuf[tokens[1].idx]);
+                        cmd.action=ACTION_POS;
+                        queue_request(&cmd);
+                    }
+                    else if ((numparam==1) && (axis_token(&rxbuf[tokens[1].idx])==SEL_WHEELS))
+                    {
+                        cmd.sub_action = POS_WHEELS;
+                        cmd.action=ACTION_POS;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        PRINTF("Error, required parameter %s\n\r", top_help[kw]);
+                    }
+                    break;
+                case 15: // coils
+                    cmd.action=ACTION_COILS;
+                    queue_request(&cmd);
+                    break;
+                case 16: // jog
+                    if (numparam==2)
+                    {
+                        cmd.sub_action = PAIR_JOG;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        cmd.value2 = toint(&rxbuf[tokens[2].idx]);
+                        if (DBG_PRINT) PRINTF("params are %ld %ld\n\r", (long)cmd.value, (long)cmd.value2);
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        PRINTF("Error, required parameters %s\n\r", top_help[kw]);
+                    }
+                    break;
+                case 17: // stop
+                    halt_command(HALT_OP_STOP);
+                    break;
+                case 18: // abort
+                    halt_command(HALT_OP_ABORT);
+                    break;
+                case 19: // pause
+                    halt_command(HALT_OP_PAUSE);
+                    break;
+                case 20: // resume
+                    halt_command(HALT_OP_RESUME);
+                    break;
+                case 21: // move
+                    if (parse_until(&cmd, numparam))
+                    {
+                        PRINTF("move %s %ld until %s %s\n\r", &rxbuf[tokens[1].idx], (long)cmd.value,
+                               &rxbuf[tokens[4].idx], &rxbuf[tokens[5].idx]);
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        PRINTF("Error, required parameters %s\n\r", top_help[kw]);
+                    }
+                    break;
+                case 22: // speed
+                    if ((numparam==2) && axis_token(&rxbuf[tokens[1].idx]) && (tomilli(&rxbuf[tokens[2].idx])>0))
+                    {
+                        cmd.sub_action = axis_token(&rxbuf[tokens[1].idx]);
+                        cmd.value = tomilli(&rxbuf[tokens[2].idx]);
+                        PRINTF("speed %s %s rpm\n\r", &rxbuf[tokens[1].idx], milli_str(cmd.value, nbuf));
+                        cmd.action=ACTION_SPEED;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        PRINTF("Error, required parameters %s\n\r", top_help[kw]);
+                    }
+                    break;
             }
             break;
         case MENU_ADMIN:
@@ -818,22 +1150,22 @@ void parse_input(void)
                     {
                         switch(kw) {
                             case 0:
-                                uiparam_wheelsaction = PAIR_FWD;
+                                cmd.sub_action = PAIR_FWD;
                                 break;
                             case 1:
-                                uiparam_wheelsaction = PAIR_REV;
+                                cmd.sub_action = PAIR_REV;
                                 break;
                             case 2:
-                                uiparam_wheelsaction = PAIR_LEFT;
+                                cmd.sub_action = PAIR_LEFT;
                                 break;
                             case 3:
-                                uiparam_wheelsaction = PAIR_RIGHT;
+                                cmd.sub_action = PAIR_RIGHT;
                                 break;
                         }
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_WHEELS;
-                        modechange=1;
+                        cmd.value = (kw>=2) ? tomilli(&rxbuf[tokens[1].idx]) : toint(&rxbuf[tokens[1].idx]); // degrees are in thousandths
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -841,21 +1173,19 @@ void parse_input(void)
                     }
                     break;
                 case 4: // pu
-                    uiparam_valueparam = PU_ANG;
-                    uiparam_doaction=ACTION_SERVO;
-                    modechange=1;
+                    cmd.value = PU_ANG;
+                    cmd.action=ACTION_SERVO;
+                    queue_request(&cmd);
                     break;
                 case 5: // pd
-                    uiparam_valueparam = PD_ANG;
-                    uiparam_doaction=ACTION_SERVO;
-                    modechange=1;
+                    cmd.value = PD_ANG;
+                    cmd.action=ACTION_SERVO;
+                    queue_request(&cmd);
                     break;
                 case 6: // servo
-                    if (numparam==1) {
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
-                        uiparam_doaction=ACTION_SERVO;
-                        modechange=1;
+                    if (parse_servo(&cmd, numparam)) {
+                        if (DBG_PRINT) PRINTF("params are %ld %ld\n\r", (long)cmd.value, (long)cmd.value2);
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -865,18 +1195,18 @@ void parse_input(void)
                 case 7: // m3
                     if (numparam>=1)
                     {
-                        uiparam_motoraction = ROT_M3;
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
+                        cmd.sub_action = ROT_M3;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
                         if (numparam>=2) {
                             if (strcmp(&rxbuf[tokens[2].idx], "cw") == 0) {
                                 // no change
                             } else if (strcmp(&rxbuf[tokens[2].idx], "ccw") == 0) {
-                                uiparam_valueparam = 0 - uiparam_valueparam;
+                                cmd.value = 0 - cmd.value;
                             }
                         }
-                        uiparam_doaction=ACTION_MOTOR;
-                        modechange=1;
+                        cmd.action=ACTION_MOTOR;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -886,18 +1216,18 @@ void parse_input(void)
                 case 8: // m4
                     if (numparam>=1)
                     {
-                        uiparam_motoraction = ROT_M4;
-                        uiparam_valueparam = todouble(&rxbuf[tokens[1].idx]);
-                        if (DBG_PRINT) PRINTF("param is %lf\n\r", uiparam_valueparam);
+                        cmd.sub_action = ROT_M4;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
                         if (numparam>=2) {
                             if (strcmp(&rxbuf[tokens[2].idx], "cw") == 0) {
                                 // no change
                             } else if (strcmp(&rxbuf[tokens[2].idx], "ccw") == 0) {
-                                uiparam_valueparam = 0 - uiparam_valueparam;
+                                cmd.value = 0 - cmd.value;
                             }
                         }
-                        uiparam_doaction=ACTION_MOTOR;
-                        modechange=1;
+                        cmd.action=ACTION_MOTOR;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -907,15 +1237,123 @@ void parse_input(void)
                 case 9: // ext
                     if (numparam==1)
                     {
-                        uiparam_extaction = EXT_OFF;
+                        cmd.sub_action = EXT_OFF;
                         if ((tokens[1].len==2) && strcmp(&rxbuf[tokens[1].idx], "on")==0) {
-                            uiparam_extaction = EXT_ON;
+                            cmd.sub_action = EXT_ON;
                         }
                         else if ((tokens[1].len==3) && strcmp(&rxbuf[tokens[1].idx], "off")==0) {
-                            uiparam_extaction = EXT_OFF;
+                            cmd.sub_action = EXT_OFF;
                         }
-                        uiparam_doaction=ACTION_EXT;
-                        modechange=1;
+                        cmd.action=ACTION_EXT;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        m2m_response((char *)RESP_BADREQ);
+                    }
+                    break;
+                case 10: // arc
+                    if (numparam==2)
+                    {
+                        cmd.sub_action = PAIR_ARC;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        cmd.value2 = tomilli(&rxbuf[tokens[2].idx]);
+                        if (DBG_PRINT) PRINTF("params are %ld %ld\n\r", (long)cmd.value, (long)cmd.value2);
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        m2m_response((char *)RESP_BADREQ);
+                    }
+                    break;
+                case 11: // goto
+                    if ((numparam==2) && motor_token(&rxbuf[tokens[1].idx]))
+                    {
+                        cmd.sub_action = (motor_token(&rxbuf[tokens[1].idx])==ROT_M3) ? GOTO_M3 : GOTO_M4;
+                        cmd.value = toint(&rxbuf[tokens[2].idx]);
+                        if (DBG_PRINT) PRINTF("param is %ld\n\r", (long)cmd.value);
+                        cmd.action=ACTION_MOTOR;
+                        queue_request(&cmd);
+                    }
+                    else if (numparam==2)
+                    {
+                        cmd.sub_action = PAIR_GOTO;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        cmd.value2 = toint(&rxbuf[tokens[2].idx]);
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        m2m_response((char *)RESP_BADREQ);
+                    }
+                    break;
+                case 12: // pos
+                    if ((numparam==1) && motor_token(&rxbuf[tokens[1].idx]))
+                    {
+                        cmd.sub_action = motor_token(&rxbuf[tokens[1].idx]);
+                        cmd.action=ACTION_POS;
+                        queue_request(&cmd);
+                    }
+                    else if ((numparam==1) && (axis_token(&rxbuf[tokens[1].idx])==SEL_WHEELS))
+                    {
+                        cmd.sub_action = POS_WHEELS;
+                        cmd.action=ACTION_POS;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        m2m_response((char *)RESP_BADREQ);
+                    }
+                    break;
+                case 13: // coils
+                    cmd.action=ACTION_COILS;
+                    queue_request(&cmd);
+                    break;
+                case 14: // jog
+                    if (numparam==2)
+                    {
+                        cmd.sub_action = PAIR_JOG;
+                        cmd.value = toint(&rxbuf[tokens[1].idx]);
+                        cmd.value2 = toint(&rxbuf[tokens[2].idx]);
+                        cmd.action=ACTION_WHEELS;
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        m2m_response((char *)RESP_BADREQ);
+                    }
+                    break;
+                case 15: // stop
+                    halt_command(HALT_OP_STOP);
+                    break;
+                case 16: // abort
+                    halt_command(HALT_OP_ABORT);
+                    break;
+                case 17: // pause
+                    halt_command(HALT_OP_PAUSE);
+                    break;
+                case 18: // resume
+                    halt_command(HALT_OP_RESUME);
+                    break;
+                case 19: // move
+                    if (parse_until(&cmd, numparam))
+                    {
+                        queue_request(&cmd);
+                    }
+                    else
+                    {
+                        m2m_response((char *)RESP_BADREQ);
+                    }
+                    break;
+                case 20: // speed
+                    if ((numparam==2) && axis_token(&rxbuf[tokens[1].idx]) && (tomilli(&rxbuf[tokens[2].idx])>0))
+                    {
+                        cmd.sub_action = axis_token(&rxbuf[tokens[1].idx]);
+                        cmd.value = tomilli(&rxbuf[tokens[2].idx]);
+                        cmd.action=ACTION_SPEED;
+                        queue_request(&cmd);
                     }
                     else
                     {
@@ -935,8 +1373,8 @@ void parse_input(void)
   for (i=0; i<numtok; i++)
   {
     rxbuf[tokens[i].idx+tokens[i].len]='\0';
-    dvar = todouble(&rxbuf[tokens[i].idx]);
-    if (DBG_PRINT) printf("double is %lf\n\r", dvar);
+    nvar = tomilli(&rxbuf[tokens[i].idx]);
+    if (DBG_PRINT) printf("number is %s\n\r", milli_str(nvar, nbuf));
     }
     
     
@@ -960,6 +1398,97 @@ void m2m_response(char* s)
     }
 }
 
+// queue_request: pass a parsed request on to handle_requests(). The parser runs ahead of execution,
+// so if the queue is full the request is dropped and the sender is told to retry.
+void queue_request(ui_cmd_t* cmd)
+{
+    if (num_error) {
+        if (menulevel == MENU_M2M) {
+            m2m_response((char *)RESP_BADREQ);
+        } else {
+            PRINTF("Error, invalid number, use digits with an optional k, M or m suffix\n\r");
+        }
+        return;
+    }
+    if (UiQueue.push(*cmd)) {
+        return;
+    }
+    if (menulevel == MENU_M2M) {
+        m2m_response((char *)RESP_BUSY);
+    } else {
+        PRINTF("busy, request not queued\n\r");
+    }
+}
+
+// halt_command: stop, abort, pause or resume. These act on the program counter here, and on the motors
+// straight away, rather than waiting in the queue behind the requests they are meant to interrupt.
+void halt_command(char op)
+{
+    switch(op)
+    {
+        case HALT_OP_STOP:
+        case HALT_OP_ABORT:
+            prog_active=0;
+            prog_paused=0;
+            break;
+        case HALT_OP_PAUSE:
+            prog_paused=1;
+            break;
+        case HALT_OP_RESUME:
+            prog_paused=0;
+            break;
+        default:
+            break;
+    }
+    request_halt(op);
+}
+
+// program_start: feed lines to the parser, one at a time as the request queue has room, until an empty line
+void program_start(const char* const* lines)
+{
+    prog_lines=lines;
+    prog_idx=0;
+    prog_paused=0;
+    prog_active=1;
+}
+
+// program_poll: parse the next program line. Called from the interface alarm, so the lines and any
+// typed commands are parsed in the same context. Waits while a typed line is part way through.
+void program_poll(void)
+{
+    const char* line;
+
+    if ((!prog_active) || prog_paused || (pc_idx!=0) || UiQueue.full())
+        return;
+    line=prog_lines[prog_idx];
+    if (line[0]=='\0')
+    {
+        prog_active=0; // finished
+        return;
+    }
+    prog_idx++;
+    if (menulevel!=MENU_M2M)
+    {
+        PRINTF("cmd: %s\n\r", line);
+    }
+    process_line((char*)line);
+}
+
+int program_running(void)
+{
+    return(prog_active);
+}
+
+int program_paused(void)
+{
+    return(prog_active && prog_paused);
+}
+
+int program_line(void)
+{
+    return(prog_idx);
+}
+
 // non-interactive mode
 void process_line(char* line)
 {
@@ -973,6 +1502,7 @@ int64_t pcui_callback(alarm_id_t id, void *user_data)
 {
     int ci;
     char c;
+    program_poll();
 #ifdef LINUX
         char x, y;
         int cc;
@@ -2,6 +2,7 @@
 #define FEMTOCLI_HEADER_
 
 #include "pico/stdlib.h"
+#include "spscqueue.h"
 
 #define RXMAXLEN 100
 
@@ -14,6 +15,10 @@
 #define ACTION_SERVO 2
 #define ACTION_MOTOR 3
 #define ACTION_EXT 4
+#define ACTION_POS 5
+#define ACTION_COILS 6
+#define ACTION_UNTIL 7
+#define ACTION_SPEED 8
 
 #define MODIFIER_NULL 0
 #define MODIFIER_ON 1
@@ -23,27 +28,69 @@
 #define PAIR_REV 0
 #define PAIR_LEFT 2
 #define PAIR_RIGHT 3
+#define PAIR_ARC 4
+#define PAIR_JOG 5
+#define PAIR_GOTO 6
 
 #define ROT_M3 3
 #define ROT_M4 4
+#define GOTO_M3 5
+#define GOTO_M4 6
+#define POS_WHEELS 1 // pos sub_action for the pose of the wheels, beside ROT_M3 and ROT_M4
+
+// servo requests (sub_action), the pu and pd commands are SERVO_ANG for servo 0
+#define SERVO_OP_MASK 0x0f
+#define SERVO_ID_SHIFT 4 // the servo id is in the upper bits of sub_action
+#define SERVO_ID_MAX 7
+#define SERVO_ANG 0 // value is the angle in degrees
+#define SERVO_PULSE 1 // value is the pulse width in microseconds
+#define SERVO_RANGE 2 // value and value2 are the narrowest and widest pulse widths in microseconds
+#define SERVO_SETTLE 3 // value is a move in degrees and value2 the time the servo takes for it, in msec
+#define SERVO_SLEW 4 // value is the slew rate in degrees per second, or 0
 
 #define EXT_ON 1
 #define EXT_OFF 0
 
+// axis selected by the speed and move commands (sub_action)
+#define SEL_WHEELS 1
+#define SEL_M3 2
+#define SEL_M4 3
+
+// move until trigger: the pin and edge (value2) that end the move
+#define TRIG_EXT 1 // a switch on the external power pin, which becomes an input with a pull-up
+#define TRIG_BUTTON 2 // the operator button
+#define TRIG_PIN_MASK 0x0f
+#define TRIG_RISE 0x10
+#define TRIG_FALL 0x20
+
+// stop, abort, pause and resume are not queued behind the other requests, they go straight to request_halt()
+#define HALT_OP_STOP 1 // decelerate to rest and drop the queued moves
+#define HALT_OP_ABORT 2 // stop without decelerating and drop the queued moves
+#define HALT_OP_PAUSE 3 // decelerate to rest, keeping the moves, and pause the program
+#define HALT_OP_RESUME 4 // continue the moves and the program
+
 #define RESP_PROCESSING "PR\n\r"
 #define RESP_OK "OK\n\r"
 #define RESP_BADREQ "BR\n\r"
+#define RESP_BUSY "BY\n\r" // the request queue is full, the request was dropped
+
+#define UI_QUEUE_LEN 8 // requests parsed ahead of execution, must be a power of 2
+
+// a parsed request, queued by the user interface for handle_requests() in main.cpp
+typedef struct ui_cmd_s {
+    char action; // ACTION_*
+    char sub_action; // PAIR_* for wheels, ROT_* or GOTO_* for motor and pos, EXT_* for ext, SEL_* for until and speed,
+                     // SERVO_* and the servo id for servo
+    int32_t value; // steps, milli-degrees for a turn, degrees for the servo, or thousandths of an rpm for speed
+    int32_t value2; // milli-degrees for an arc, rpm for jog, or TRIG_* for until
+    int32_t feed; // thousandths of an rpm from an @ suffix on a move, or 0 for the axis speed
+} ui_cmd_t;
 
 //extern Serial pc;
 
-extern char uiparam_wheelsaction;
-extern char uiparam_motoraction;
-extern char uiparam_extaction;
-extern double uiparam_valueparam;
-extern char modechange;
+extern SpscQueue<ui_cmd_t, UI_QUEUE_LEN> UiQueue; // filled by the parser, emptied by handle_requests()
 extern char uiparam_adminmode;
 extern char uiparam_m2mmode;
-extern char uiparam_doaction;
 extern char uiparam_modifier;
 extern uint32_t alarmPeriod;
 
@@ -53,5 +100,13 @@ void clear_hist_buffer(void);
 void set_menu(char m);
 void m2m_response(char* s);
 void process_line(char* line); // non-interactive mode
+void queue_request(ui_cmd_t* cmd); // queue a parsed request, or reply busy if the queue is full
+void request_halt(char op); // in main.cpp, pass a HALT_OP_* to the motors straight away
+void program_start(const char* const* lines); // feed the lines (up to an empty one) to the parser
+void program_poll(void); // parse the next program line if the request queue has room
+int program_running(void); // non-zero until the program has been fed or it is stopped
+int program_paused(void);
+int program_line(void); // number of program lines fed so far
+char* milli_str(int32_t v, char* buf); // format thousandths as a decimal number, buf is at least 16 chars
 
 #endif // FEMTOCLI_HEADER_
@@ -0,0 +1,119 @@
+/******************************************************
+ * fixtrig.cpp
+ * Fixed Point Trigonometry
+ * ****************************************************/
+
+#include "fixtrig.h"
+
+static constexpr FixSinTable sin_table = fixtrig_sin_table();
+
+static_assert(sin_table.v[0] == 0, "sine table must start at 0");
+static_assert(sin_table.v[FIXTRIG_POINTS] == FIXTRIG_ONE, "sine table must end at 1.0");
+
+// quarter_sin: sine of 0 to FIXTRIG_QUARTER milli-degrees, interpolated between the table points
+static int32_t quarter_sin(int32_t mdeg) {
+    int32_t pos = mdeg * FIXTRIG_POINTS; // table position, in 1/FIXTRIG_QUARTER of a point
+    int32_t idx = pos / FIXTRIG_QUARTER;
+    int32_t rem = pos - idx * FIXTRIG_QUARTER;
+
+    if (rem == 0) {
+        return(sin_table.v[idx]);
+    }
+    return(sin_table.v[idx] + (int32_t)(((int64_t)(sin_table.v[idx + 1] - sin_table.v[idx]) * rem +
+                                         FIXTRIG_QUARTER / 2) / FIXTRIG_QUARTER));
+}
+
+int32_t fix_sin(int32_t mdeg) {
+    int32_t a = mdeg % FIXTRIG_FULL;
+
+    if (a < 0) {
+        a += FIXTRIG_FULL;
+    }
+    switch(a / FIXTRIG_QUARTER) {
+        case 0:
+            return(quarter_sin(a));
+        case 1:
+            return(quarter_sin(2 * FIXTRIG_QUARTER - a));
+        case 2:
+            return(0 - quarter_sin(a - 2 * FIXTRIG_QUARTER));
+        default:
+            break;
+    }
+    return(0 - quarter_sin(FIXTRIG_FULL - a));
+}
+
+int32_t fix_cos(int32_t mdeg) {
+    return(fix_sin((int32_t)(((int64_t)mdeg + FIXTRIG_QUARTER) % FIXTRIG_FULL)));
+}
+
+int32_t fix_atan2(int64_t y, int64_t x) {
+    int64_t ax = (x < 0) ? 0 - x : x;
+    int64_t ay = (y < 0) ? 0 - y : y;
+    int32_t lo = 0;
+    int32_t hi = FIXTRIG_QUARTER;
+    int32_t mid;
+
+    if ((ax == 0) && (ay == 0)) {
+        return(0);
+    }
+    // keep the products with the Q16 sines within 64 bits
+    while ((ax >= ((int64_t)1 << 46)) || (ay >= ((int64_t)1 << 46))) {
+        ax = ax >> 1;
+        ay = ay >> 1;
+    }
+    // ax * sin(a) - ay * cos(a) rises through zero over the first quadrant, at the angle of (ax, ay)
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (ax * quarter_sin(mid) <= ay * quarter_sin(FIXTRIG_QUARTER - mid)) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (x < 0) {
+        lo = 2 * FIXTRIG_QUARTER - lo;
+    }
+    if (y < 0) {
+        lo = 0 - lo;
+    }
+    return(fix_wrap(lo));
+}
+
+int64_t fix_hypot(int64_t x, int64_t y) {
+    return((int64_t)fix_sqrt((uint64_t)(x * x) + (uint64_t)(y * y)));
+}
+
+uint64_t fix_sqrt(uint64_t n) {
+    uint64_t r = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    // integer square root, one result bit at a time
+    while (bit > n) {
+        bit = bit >> 2;
+    }
+    while (bit != 0) {
+        if (n >= r + bit) {
+            n -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r = r >> 1;
+        }
+        bit = bit >> 2;
+    }
+    // n is now the remainder, round up if the root is nearer r + 1
+    if (n > r) {
+        r++;
+    }
+    return(r);
+}
+
+int32_t fix_wrap(int64_t mdeg) {
+    int64_t a = mdeg % FIXTRIG_FULL;
+
+    if (a > FIXTRIG_FULL / 2) {
+        a -= FIXTRIG_FULL;
+    } else if (a <= 0 - FIXTRIG_FULL / 2) {
+        a += FIXTRIG_FULL;
+    }
+    return((int32_t)a);
+}
@@ -0,0 +1,54 @@
+#ifndef __FIXTRIG_H_FILE__
+#define __FIXTRIG_H_FILE__
+
+// fixtrig.h
+// Fixed point sine, cosine and arctangent for the wheel odometry (see smotpair.h), so that the math
+// library and soft floating point are not needed at run time. Angles are in thousandths of a degree,
+// sines and cosines are Q16 (65536 is 1.0). The sine table is computed at compile time and looked up
+// with linear interpolation, which is good to the last bit of Q16.
+
+#include <stdint.h>
+
+#define FIXTRIG_ONE 65536 // 1.0 in Q16
+#define FIXTRIG_QUARTER 90000 // a quarter turn, in milli-degrees
+#define FIXTRIG_FULL 360000 // a full turn, in milli-degrees
+#define FIXTRIG_POINTS 256 // sine table points per quarter turn
+
+// sine over a quarter turn, in Q16
+struct FixSinTable {
+    int32_t v[FIXTRIG_POINTS + 1];
+};
+
+// sine of x radians by its Taylor series, only evaluated by the compiler
+constexpr double fixtrig_series(double x) {
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 12; n++) {
+        term = 0 - term * x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return(sum);
+}
+
+constexpr FixSinTable fixtrig_sin_table(void) {
+    FixSinTable t = {};
+    for (int k = 0; k <= FIXTRIG_POINTS; k++) {
+        t.v[k] = (int32_t)(fixtrig_series(1.5707963267948966 * k / FIXTRIG_POINTS) * FIXTRIG_ONE + 0.5);
+    }
+    return(t);
+}
+
+// sine and cosine of an angle in milli-degrees (any value), in Q16
+int32_t fix_sin(int32_t mdeg);
+int32_t fix_cos(int32_t mdeg);
+// angle of the vector (x, y) from the x axis, in milli-degrees from -179999 to 180000 (positive
+// is anticlockwise), and 0 for (0, 0)
+int32_t fix_atan2(int64_t y, int64_t x);
+// length of the vector (x, y) rounded to nearest, x and y must be within +/- 2^31
+int64_t fix_hypot(int64_t x, int64_t y);
+// integer square root of n, rounded to nearest
+uint64_t fix_sqrt(uint64_t n);
+// an angle in milli-degrees wrapped to -179999 to 180000
+int32_t fix_wrap(int64_t mdeg);
+
+#endif // __FIXTRIG_H_FILE__
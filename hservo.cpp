@@ -9,21 +9,35 @@
 #include "pico/stdlib.h"
 #include "pico/time.h"
 #include "hservo.h"
+#include "servobank.h"
+#include "hardware/sync.h"
 #include "hardware/clocks.h"
+#include "stdio.h"
 #include <cstdlib>
 
+static uint32_t configured_slices = 0; // PWM slices set up for servos, servos on the same slice share it
+
 
 
 HServo::HServo(uint ionum, int initang, int maxang, uint psaveio) {
+    int i;
+
     mPsaveio = psaveio;
     mMaxang = maxang;
     mCurang = initang;
     mMinpwm = 1000; // 1000 usec = 1 msec
     mMaxpwm = 2000; // 2000 usec = 2 msec
-    mMinSleep = 300; // msec time for servo movement
-    mMaxSleep = 1000; // msec time for servo movement
-    mSleepPerdeg = (mMaxSleep - mMinSleep) / mMaxang; 
-    mPerdeg = (mMaxpwm - mMinpwm) / mMaxang;
+    // default settle times, a straight line from 300 msec (the time for the servo to respond) to 1000 msec
+    for (i=0; i<HSERVO_CURVE_POINTS; i++) {
+        mSettle[i] = 300 + (700 * i) / (HSERVO_CURVE_POINTS - 1);
+    }
+    mSlew = 0;
+    mBank = NULL;
+    mOffAlarm = 0;
+    mSlewAlarm = 0;
+    mStep = 0;
+    mLevel = ang2width(mCurang) * 1000;
+    mTarget = mLevel;
     if (mPsaveio) {
         gpio_init(mPsaveio);
         gpio_set_dir(mPsaveio, GPIO_OUT);
@@ -32,37 +46,198 @@ HServo::HServo(uint ionum, int initang, int maxang, uint psaveio) {
     gpio_set_function(ionum, GPIO_FUNC_PWM);
     mPwmslice = pwm_gpio_to_slice_num(ionum); // get slice number (0-7)
     mPwmchan = pwm_gpio_to_channel(ionum); // get channel number (0-1)
-    pwm_set_wrap(mPwmslice, 20000);
+    if (!(configured_slices & (1UL << mPwmslice))) {
+        configured_slices |= 1UL << mPwmslice;
+        pwm_set_wrap(mPwmslice, HSERVO_PERIOD_US);
+        pwm_set_clkdiv(mPwmslice, (clock_get_hz(clk_sys) / 1E6));
+        pwm_set_enabled(mPwmslice, true);
+    }
     pwm_set_chan_level(mPwmslice, mPwmchan, ang2width(mCurang));
-    pwm_set_clkdiv(mPwmslice, (clock_get_hz(clk_sys) / 1E6));
-
-    pwm_set_enabled(mPwmslice, true);
     if (mPsaveio) {
         gpio_put(mPsaveio, 1); // turn on the servo power
     }
-    sleep_ms(mMaxSleep + mMinSleep);
+    sleep_ms(mSettle[0] + mSettle[HSERVO_CURVE_POINTS - 1]);
     if (mPsaveio) {
         gpio_put(mPsaveio, 0); // turn off the servo power
     }
+    mReadyAt = get_absolute_time();
 }
 
+// ang2width: pulse width in usec for an angle, rounded to nearest (0 degrees is mMaxpwm)
 int HServo::ang2width(int ang) {
-    return(((180-ang) * mPerdeg) + mMinpwm);
+    return(mMinpwm + ((mMaxang - ang) * (mMaxpwm - mMinpwm) + mMaxang / 2) / mMaxang);
+}
+
+// width2ang: angle in degrees for a pulse width in usec, the inverse of ang2width
+int HServo::width2ang(int us) {
+    return(mMaxang - ((us - mMinpwm) * mMaxang + (mMaxpwm - mMinpwm) / 2) / (mMaxpwm - mMinpwm));
+}
+
+// settleTime: msec for the servo to complete a move of deg degrees, from the settle time curve
+int HServo::settleTime(int deg) {
+    int pos;
+    int idx;
+    int rem;
+
+    if (deg >= mMaxang) {
+        return(mSettle[HSERVO_CURVE_POINTS - 1]);
+    }
+    pos = deg * (HSERVO_CURVE_POINTS - 1); // position along the curve, in 1/mMaxang of a point
+    idx = pos / mMaxang;
+    rem = pos - idx * mMaxang;
+    return(mSettle[idx] + ((mSettle[idx + 1] - mSettle[idx]) * rem + mMaxang / 2) / mMaxang);
 }
 
 void HServo::setAng(int ang) {
     // just return if the user requests zero or very small angle differences
     if (abs(mCurang - ang) < 5)
         return;
-    pwm_set_chan_level(mPwmslice, mPwmchan, ang2width(ang));
+    if (setPulse(ang2width(ang))) {
+        mCurang = ang;
+    }
+}
+
+bool HServo::setPulse(int us) {
+    int deg;
+    int ms;
+    uint32_t irq;
+
+    if ((us < HSERVO_PULSE_MIN) || (us > HSERVO_PULSE_MAX)) {
+        printf("error, pulse width out of range!\n");
+        return(false);
+    }
+    // the alarms of the previous move are replaced by the ones for this move
+    cancel();
+    // a bank scheduler reads the move from interrupt context
+    irq = save_and_disable_interrupts();
+    // size of the move, from the pulse width being output (part way along a slew, if one was cut short)
+    deg = (int)(((int64_t)abs(us * 1000 - mLevel) * mMaxang / abs(mMaxpwm - mMinpwm) + 500) / 1000);
+    mTarget = us * 1000;
+    mStep = 0;
+    ms = settleTime(deg);
+    if ((mSlew > 0) && (deg > 0)) {
+        mStep = (int32_t)(((int64_t)mSlew * abs(mMaxpwm - mMinpwm) * HSERVO_SLEW_MS) / mMaxang);
+        if (mStep < 1) {
+            mStep = 1;
+        }
+        if ((deg * 1000) / mSlew + mSettle[0] > ms) {
+            // the servo follows the ramp, and then settles as it does for a small move
+            ms = (deg * 1000) / mSlew + mSettle[0];
+        }
+    }
+    mReadyAt = make_timeout_time_ms(ms);
+    restore_interrupts(irq);
     if (mPsaveio) {
         gpio_put(mPsaveio, 1); // turn on the servo power
     }
-    sleep_ms(mMinSleep + (mSleepPerdeg * abs(ang - mCurang)));
+    mCurang = width2ang(us);
+    if (mBank != NULL) {
+        mBank->kick(); // output at the bank's next tick, in one batch with the other servos
+        return(true);
+    }
+    if (mStep > 0) {
+        mSlewAlarm = add_alarm_in_ms(HSERVO_SLEW_MS, slew_callback, this, true);
+        if (mSlewAlarm <= 0) {
+            mSlewAlarm = 0;
+            mStep = 0; // no alarm, so the servo moves at its own speed
+        }
+    }
+    if (mSlewAlarm == 0) {
+        mLevel = mTarget;
+        pwm_set_chan_level(mPwmslice, mPwmchan, us);
+    }
     if (mPsaveio) {
-        gpio_put(mPsaveio, 0); // turn off the servo power
+        mOffAlarm = add_alarm_at(mReadyAt, off_callback, this, true);
+        if (mOffAlarm <= 0) {
+            mOffAlarm = 0;
+            gpio_put(mPsaveio, 0); // no alarm, so the move is left to complete without servo power
+        }
+    }
+    return(true);
+}
+
+bool HServo::range(int min_us, int max_us) {
+    if ((min_us < HSERVO_PULSE_MIN) || (max_us > HSERVO_PULSE_MAX) || (min_us >= max_us)) {
+        printf("error, pulse width range must be within %d to %d usec!\n", HSERVO_PULSE_MIN, HSERVO_PULSE_MAX);
+        return(false);
     }
-    mCurang = ang;
+    mMinpwm = min_us;
+    mMaxpwm = max_us;
+    return(true);
 }
 
+bool HServo::settle(int deg, int ms) {
+    if ((deg < 0) || (deg > mMaxang) || (((deg * (HSERVO_CURVE_POINTS - 1)) % mMaxang) != 0)) {
+        printf("error, settle times are set every %d degrees!\n", mMaxang / (HSERVO_CURVE_POINTS - 1));
+        return(false);
+    }
+    if (ms < 0) {
+        printf("error, settle time cannot be negative!\n");
+        return(false);
+    }
+    mSettle[(deg * (HSERVO_CURVE_POINTS - 1)) / mMaxang] = ms;
+    return(true);
+}
+
+bool HServo::slew(int dps) {
+    if (dps < 0) {
+        printf("error, slew rate cannot be negative!\n");
+        return(false);
+    }
+    mSlew = dps;
+    return(true);
+}
+
+bool HServo::ready(void) {
+    return(time_reached(mReadyAt));
+}
+
+void HServo::wait(void) {
+    sleep_until(mReadyAt);
+}
+
+// step: move the pulse width being output one slew step towards the target (or straight to it if the servo is
+// not slewing), returns it in usec
+int HServo::step(void) {
+    int32_t left = mTarget - mLevel;
+
+    if ((mStep == 0) || (abs(left) <= mStep)) {
+        mLevel = mTarget;
+    } else {
+        mLevel = mLevel + ((left > 0) ? mStep : 0 - mStep);
+    }
+    return((mLevel + 500) / 1000);
+}
+
+// cancel: cancel the power off and slew alarms, if they are pending
+void HServo::cancel(void) {
+    if (mOffAlarm > 0) {
+        cancel_alarm(mOffAlarm);
+        mOffAlarm = 0;
+    }
+    if (mSlewAlarm > 0) {
+        cancel_alarm(mSlewAlarm);
+        mSlewAlarm = 0;
+    }
+}
 
+// off_callback: turn off the servo power once the move has completed, called from interrupt context
+int64_t HServo::off_callback(alarm_id_t id, void* user_data) {
+    HServo* servo = (HServo*)user_data;
+
+    servo->mOffAlarm = 0;
+    gpio_put(servo->mPsaveio, 0); // turn off the servo power
+    return(0); // don't repeat
+}
+
+// slew_callback: step the pulse width towards the target, once per PWM period. Called from interrupt context.
+int64_t HServo::slew_callback(alarm_id_t id, void* user_data) {
+    HServo* servo = (HServo*)user_data;
+
+    pwm_set_chan_level(servo->mPwmslice, servo->mPwmchan, servo->step());
+    if (servo->mLevel == servo->mTarget) {
+        servo->mSlewAlarm = 0;
+        return(0); // at the target, don't repeat
+    }
+    return(0 - HSERVO_SLEW_MS * 1000); // negative is from the time this step was due, so the rate does not drift
+}
@@ -2,32 +2,74 @@
 #define __HSERVO_HEADER_FILE__
 
 #include "pico/stdlib.h"
+#include "pico/time.h"
 
 // pen down and pen up angles
-#define PD_ANG 50.0
-#define PU_ANG 100.0
+#define PD_ANG 50
+#define PU_ANG 100
+
+// pulse widths are whole microseconds, the PWM counts at 1 MHz and wraps every 20 msec
+#define HSERVO_PERIOD_US 20000
+#define HSERVO_PULSE_MIN 500 // widest range of pulse widths accepted, in microseconds
+#define HSERVO_PULSE_MAX 2500
+// settle time curve: the time taken by moves of 0, 1/4, 1/2, 3/4 and all of the max angle
+#define HSERVO_CURVE_POINTS 5
+#define HSERVO_SLEW_MS 20 // the slew ramp updates the pulse width once per PWM period
+
+class ServoBank;
 
 class HServo {
+    friend class ServoBank;
     public:
         // HServo constructor
         HServo(uint ionum, int initang=0, int maxang=180, uint psaveio=0);
-        // Set hobby servo angle in degrees
+        // Set hobby servo angle in degrees. Returns immediately, the servo power (if power saving is enabled)
+        // is switched off by a timer alarm once the servo has had time to complete the move. A servo in a
+        // ServoBank is moved by the bank's scheduler instead (see servobank.h).
         void setAng(int ang);
+        // Set the pulse width in microseconds (HSERVO_PULSE_MIN to HSERVO_PULSE_MAX), e.g. to find the range
+        // of a servo. Returns immediately, as setAng() does.
+        bool setPulse(int us);
+        // Set the pulse widths at the ends of travel, in microseconds: max_us at 0 degrees and min_us at the
+        // max angle. The default is 1000 to 2000.
+        bool range(int min_us, int max_us);
+        // Set the measured time, in msec, for the servo to complete a move of deg degrees. deg is one of the
+        // points of the settle time curve (0, 1/4, 1/2, 3/4 or all of the max angle), and the times in between
+        // are interpolated. The default curve rises from 300 msec for a small move to 1000 msec for the max angle.
+        bool settle(int deg, int ms);
+        // Slew the pulse width from a timer at dps degrees per second, so that the servo moves smoothly.
+        // 0 (the default) sets the new pulse width at once.
+        bool slew(int dps);
+        // Returns true once the servo is expected to have reached the last angle set
+        bool ready(void);
+        // Wait until ready() is true
+        void wait(void);
 
     private:
+        static int64_t off_callback(alarm_id_t id, void* user_data);
+        static int64_t slew_callback(alarm_id_t id, void* user_data);
+        ServoBank* mBank; // bank that outputs the pulse width and runs the timers, or NULL
         uint mPwmchan;
         uint mPwmslice;
         int mMaxang;
         int mCurang;
-        int mPerdeg;
-        int mMinSleep; // msec time for servo to respond
-        int mMaxSleep; // msec time for servo to complete max angle rotation
-        int mSleepPerdeg; // msec time for servo to move by 1 degree
+        int mSettle[HSERVO_CURVE_POINTS]; // msec time for the servo to complete moves along the curve
+        int mSlew; // slew rate in degrees per second, or 0
         int mMinpwm; // e.g. 1000 usec (1 msec)
         int mMaxpwm; // e.g. 2000 usec (2 msec)
         uint mPsaveio; // gpio number for servo power enable. If zero, power save is disabled.
+        absolute_time_t mReadyAt; // time the servo is expected to complete the last move
+        volatile alarm_id_t mOffAlarm; // alarm that switches the servo power off, or 0
+        volatile alarm_id_t mSlewAlarm; // alarm that steps the pulse width during a slew, or 0
+        volatile int32_t mLevel; // pulse width being output, in 1/1000 usec
+        int32_t mTarget; // pulse width the slew is heading for, in 1/1000 usec
+        int32_t mStep; // change of pulse width on each slew step, in 1/1000 usec
 
         int ang2width(int ang);
+        int width2ang(int us);
+        int settleTime(int deg);
+        int step(void);
+        void cancel(void);
 };
 
 
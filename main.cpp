@@ -11,11 +11,14 @@
 #include <cstdlib>
 #include "stdio.h"
 #include "pico/time.h"
+#include "pico/multicore.h"
+#include "pico/util/queue.h"
 #include "smot.h"
 #include "smotpair.h"
 #include "femtocli.h"
 #include "timer.h"
 #include "hservo.h"
+#include "servobank.h"
 
 // *********** function prototypes ****************
 
@@ -39,6 +42,21 @@
 // WHEELSTEPSDEGREE = (wheel_separation/wheel_diameter) * (WHEELSTEPS360/ 360)
 // example: wheel_separation = 86 mm, wheel_diameter = 28 mm, WHEELSTEPS360 = 1000, then result is 8.532
 #define WHEELSTEPSDEGREE 8.532
+// WHEELSTEPSDEGREE as a fixed point number with WHEEL_FIX_BITS fraction bits, the compiler folds the
+// floating point constant so that turns need no floating point at run time
+#define WHEEL_FIX_BITS PAIR_TURN_FIX_BITS
+#define WHEELSTEPSDEGREE_FIX ((int32_t)(WHEELSTEPSDEGREE * (1L << WHEEL_FIX_BITS) + 0.5))
+// half the wheel separation in motor steps, for driving arcs. This is WHEELSTEPSDEGREE * 180 / pi, worked out
+// from the fixed point value with the same fraction for pi as the arcs (see smotpair.h)
+#define WHEELHALFTRACK ((long)((((int64_t)WHEELSTEPSDEGREE_FIX * 180 * ARC_PI_DEN / ARC_PI_NUM) + \
+                               (1L << (WHEEL_FIX_BITS - 1))) >> WHEEL_FIX_BITS))
+// maximum acceleration in rpm per second, for the wheels and for motors M3 and M4
+#define WHEEL_ACCEL 400
+#define MOTOR_ACCEL 200
+// time the coils stay energized after a move, so that the next move can start at full speed
+#define COIL_IDLE_MS 500
+// the wheels stop if no new jog speeds arrive within this time
+#define WHEEL_DEADMAN_MS 200
 
 #define BAUD 115200
 
@@ -46,32 +64,95 @@
 #define PAIR_REV 0
 #define PAIR_LEFT 2
 #define PAIR_RIGHT 3
+#define PAIR_ARC 4
+#define PAIR_JOG 5
+#define PAIR_GOTO 6
 
 #define RESP_PROCESSING "PR\n\r"
 #define RESP_OK "OK\n\r"
+// sent when an axis has completed all its queued moves
+#define RESP_DONE_WHEELS "DW\n\r"
+#define RESP_DONE_M3 "D3\n\r"
+#define RESP_DONE_M4 "D4\n\r"
+
+// independent axes, each runs its own queue of moves at its own speed
+#define AXIS_WHEELS 0
+#define AXIS_M3 1
+#define AXIS_M4 2
+#define NUM_AXES 3
+
+// moves sent from core0 to core1, in one queue per axis. Core1 waits for space in the axis before taking
+// each one, so an axis that is busy only holds up its own moves.
+#define MOTION_QUEUE_LEN 8
+#define MOTION_CORE_READY 0x4d4f5421 // pushed to the inter-core FIFO once core1 has set up the motors
+// halt requests bypass motion_queue, they are sent through the inter-core FIFO as MOTION_HALT | HALT_OP_*,
+// and core1 sends the same word back once it has acted on them (with MOTION_REFUSED if an axis could not)
+#define MOTION_HALT 0x48410000
+#define MOTION_HALT_MASK 0xffff0000
+#define MOTION_REFUSED 0x100
+// motion_cmd_t actions for any axis: a move until trigger, and a change of speed
+#define MOTION_UNTIL 8
+#define MOTION_SPEED 9
+
+// move until trigger state, set by core1 and returned to TRIG_IDLE by core0 once reported
+#define TRIG_IDLE 0
+#define TRIG_ARMED 1 // the move is running, waiting for the edge
+#define TRIG_HIT 2 // the edge stopped the move, the position is latched
+#define TRIG_MISSED 3 // the move ended without the edge
+
+// a move for core1 to queue to one of the axes
+typedef struct motion_cmd_s {
+    char axis; // AXIS_WHEELS, AXIS_M3 or AXIS_M4
+    char action; // PAIR_* for the wheels, ROT_* or GOTO_* for M3 and M4
+    int value; // steps, target position, arc radius in steps, or x for a wheels goto
+    int value2; // arc angle in milli-degrees, y for a wheels goto, or TRIG_* for a move until trigger
+    int feed; // speed of the move in thousandths of an rpm, or 0 for the axis speed
+} motion_cmd_t;
 
 //************ global vars ***********************
 char usb_control = 0; // determines if the USB serial is used to control the board or not
-SMotPair Wheels(1, 2, WHEELSTEPS360, 1); // drivers 1 and 2 are connected to wheels, 1000 steps per 360 degree revolution, power save mode enabled
-SMot Motor3(3, 1000, 1); // driver #3, 1000 steps per 360 deg revolution, powersave on
-SMot Motor4(4, 1000, 1);// driver #4, 1000 steps per 360 deg revolution, powersave on
+// the motors are driven by PIO state machines (they fall back to GPIO if the PIO cannot be used)
+SMotPair<1, 2> Wheels(WHEELSTEPS360, 1, BACKEND_PIO); // drivers 1 and 2 are connected to wheels, 1000 steps per 360 degree revolution, power save mode enabled
+SMot<3> Motor3(1000, 1, BACKEND_PIO); // driver #3, 1000 steps per 360 deg revolution, powersave on
+SMot<4> Motor4(1000, 1, BACKEND_PIO);// driver #4, 1000 steps per 360 deg revolution, powersave on
 // user interface related params
-char uiparam_wheelsaction=0;
-char uiparam_motoraction=0;
-char uiparam_extaction=0;
-double uiparam_valueparam=0.0;
-char modechange=0;
+SpscQueue<ui_cmd_t, UI_QUEUE_LEN> UiQueue; // requests from the parser, which runs in the user interface alarm
 char uiparam_adminmode=0;
 char uiparam_m2mmode=0;
-char uiparam_doaction=ACTION_IDLE;
 char uiparam_modifier=MODIFIER_ON;
 // repeating timer
 uint32_t alarmPeriod;
 alarm_pool_t* alarm_pool;
 alarm_id_t ui_alarm_id;
+alarm_pool_t* motion_alarm_pool; // times the motor steps, created on core1 so the step alarms run there
+queue_t motion_queue[NUM_AXES]; // moves from core0 to core1, for each axis
+volatile uint32_t motion_sent[NUM_AXES]; // moves added to motion_queue for each axis, written by core0 only
+volatile uint32_t motion_taken[NUM_AXES]; // moves taken from motion_queue for each axis, written by core1 only
+// queued moves for the wheels and motors M3 and M4 (fixed size, nothing is allocated)
+Planner WheelPlan;
+Planner Motor3Plan;
+Planner Motor4Plan;
+volatile char axis_done[NUM_AXES]; // set from interrupt context when an axis completes its queued moves
+volatile char halt_op = 0; // halt request waiting to be reported, or 0
+volatile uint32_t halt_ack = 0; // reply from core1 to the halt request, or 0
+volatile uint64_t halt_sent_us; // time the halt request was sent to core1
+volatile char ui_drop = 0; // set when the requests queued so far are to be dropped
+volatile uint32_t ui_drop_to; // count of requests pushed to UiQueue at the time
+// move until trigger, one at a time. The GPIO interrupt runs on core1 with the step alarms.
+volatile char trig_state = TRIG_IDLE;
+volatile int trig_axis = -1; // axis of the move
+volatile uint trig_gpio; // pin and edge being waited for
+volatile uint32_t trig_edge;
+volatile int64_t trig_pos[2]; // position of the axis when the move ended, in steps (both wheels, or the motor)
+volatile char trig_button = 0; // core0: 1 while the operator button ends a move, 2 once reported
+const char* const axis_name[NUM_AXES] = {"wheels", "m3", "m4"};
+const char* const axis_resp[NUM_AXES] = {RESP_DONE_WHEELS, RESP_DONE_M3, RESP_DONE_M4};
 // hobby servo
 // set initial angle to 0 deg, and max angle to 180 deg, and enable power-saving capability
 HServo Servo(HSERVO_CONTROL_PIN, 0, 180, HSERVO_POWER_PIN);
+// the servos are run together by one scheduler, the pen is servo 0. Servos for tools and grippers are added
+// in init() after it, e.g. Servos.add(&Gripper) for HServo Gripper(<pin>, 90, 180, HSERVO_POWER_PIN).
+ServoBank Servos;
 
 const char* const preset_program1[]={   "fwd 2k",
                                         "right 120",
@@ -87,12 +168,41 @@ extern char menulevel;
 
 //*********** function prototypes ******************
 int init(void); // initialize GPIO, detect if USB is connected
-void rotate_wheels(char sub_action_type, double value); // rotate a pair of wheels
-void move_servo(int ang); // move servo to ang value
-void rotate_motor(char sub_action_type, double value); // rotate motor M3 or M4
+void rotate_wheels(char sub_action_type, int32_t value, int32_t value2, int32_t feed); // rotate a pair of wheels
+void move_servo(int id, int ang); // move servo id to ang value
+void set_servo(char sub_action_type, int32_t value, int32_t value2); // set the pulse width or calibrate a servo
+void rotate_motor(char sub_action_type, int32_t value, int32_t feed); // rotate motor M3 or M4
+int64_t motor_position(int motornum, int queued); // absolute position of M3 or M4
+void report_pos(char sub_action_type); // report the position of M3 or M4
+void report_coils(void); // report the energized time of each axis
 void ext_pwr(char subaction); // control external power pin
 void run_program(void); // run a preset program
 void handle_requests(void); // action requests from the various interfaces
+int motion_busy(void); // check if any motor is moving
+void wait_motion(void); // wait for all queued moves to complete
+int request_ready(const ui_cmd_t* cmd); // check if a request can be actioned yet
+int request_axis(const ui_cmd_t* cmd); // axis a move request is sent to
+void axis_done_callback(void* ctx); // called when an axis completes its moves
+void report_done(void); // report axes that have completed
+void report_halt(void); // report a halt request once the motors are at rest
+void motion_core(void); // core1 main function, steps the motors
+void motion_send(char axis, char action, int value, int value2, int feed); // send a move to core1
+int motion_ready(const motion_cmd_t* cmd); // check if core1 can queue a move yet
+void motion_execute(const motion_cmd_t* cmd); // queue a move to its axis, on core1
+int axis_busy(int axis); // check if an axis has moves pending or in progress
+void motion_halt(uint32_t req); // act on a halt request, on core1
+int motion_resume(void); // resume all axes, on core1
+void motion_ack(uint32_t ack); // reply to a halt request, on core1
+void motion_until(const motion_cmd_t* cmd); // start a move until trigger, on core1
+void motion_speed(const motion_cmd_t* cmd); // set the speed of an axis, on core1
+void motion_feed(const motion_cmd_t* cmd); // set the speed of the next move, on core1
+void trigger_irq(uint gpio, uint32_t events); // GPIO interrupt that ends a move until trigger, on core1
+void trigger_latch(char state); // note where the axis stopped, on core1
+void trigger_check(void); // notice a move until trigger that ended without the edge, on core1
+void move_until(char axis, int32_t value, int32_t value2, int32_t feed); // move an axis until a trigger
+void set_speed(char axis, int32_t mrpm); // set the speed of an axis
+void report_feed(int axis, int32_t mrpm); // report the speed of a move with an @ suffix
+void report_trigger(void); // report the result of a move until trigger
 
 //************** main function *********************
 int
@@ -104,8 +214,15 @@ main (void)
     PICO_LED_ON;
 
     while(1) {
-        sleep_ms(100); // give pico some free time
+        sleep_ms(10); // give pico some free time
         handle_requests(); // check if a request is pending from any interface, and handle it
+        if (trig_button) {
+            // the button is ending a move, it does not start the program
+            if ((trig_button == 2) && BUTTON_RELEASED) {
+                trig_button = 0;
+            }
+            continue;
+        }
         // check if the user wants to run a program by pressing the operator button:
         if (BUTTON_PRESSED) {
             while(1) {
@@ -121,9 +238,389 @@ main (void)
 
 }
 
+//*************** core1 ***********************
+
+// motion_core: core1 main function. The motor step alarms are set up here so that they run on core1,
+// then the moves sent by core0 are queued to the motors in order. Each axis has its own motion_queue,
+// and a move stays at the head of it until the axis has space for it, so the other axes carry on
+// meanwhile. Halt requests arrive through the inter-core FIFO and are checked first on every pass.
+// Nothing is allocated once the loop is running.
+void __not_in_flash_func(motion_core)(void) {
+    motion_cmd_t cmd;
+    uint32_t req;
+    int resuming = 0;
+    int axis;
+    int taken;
+
+    motion_alarm_pool = alarm_pool_create(1, 4); // motor steps use hardware alarm 1 at default priority
+    Wheels.begin(motion_alarm_pool);
+    Wheels.profile(PROFILE_TRAP); // ramp the wheels up and down to avoid stalling the chassis
+    Wheels.accel(WHEEL_ACCEL);
+    Wheels.track(WHEELHALFTRACK);
+    Wheels.turnScale(WHEELSTEPSDEGREE_FIX);
+    Wheels.usePlanner(&WheelPlan);
+    Wheels.onDone(axis_done_callback, (void*)&axis_done[AXIS_WHEELS]);
+    Wheels.idleTimeout(COIL_IDLE_MS);
+    Wheels.deadman(WHEEL_DEADMAN_MS);
+    Motor3.begin(motion_alarm_pool);
+    Motor3.profile(PROFILE_SCURVE);
+    Motor3.accel(MOTOR_ACCEL);
+    Motor3.usePlanner(&Motor3Plan);
+    Motor3.onDone(axis_done_callback, (void*)&axis_done[AXIS_M3]);
+    Motor3.idleTimeout(COIL_IDLE_MS);
+    Motor4.begin(motion_alarm_pool);
+    Motor4.profile(PROFILE_SCURVE);
+    Motor4.accel(MOTOR_ACCEL);
+    Motor4.usePlanner(&Motor4Plan);
+    Motor4.onDone(axis_done_callback, (void*)&axis_done[AXIS_M4]);
+    Motor4.idleTimeout(COIL_IDLE_MS);
+    multicore_fifo_push_blocking(MOTION_CORE_READY);
+
+    while(1) {
+        if (multicore_fifo_rvalid()) {
+            req = multicore_fifo_pop_blocking();
+            resuming = (req == (MOTION_HALT | HALT_OP_RESUME));
+            if (!resuming) {
+                motion_halt(req);
+            }
+        }
+        // an axis still slowing down for a pause cannot resume yet, so resume is tried until they all have
+        if (resuming && motion_resume()) {
+            resuming = 0;
+            motion_ack(MOTION_HALT | HALT_OP_RESUME);
+        }
+        if (trig_state == TRIG_ARMED) {
+            trigger_check();
+        }
+        Wheels.odometry();
+        taken = 0;
+        for (axis = 0; axis < NUM_AXES; axis++) {
+            if (queue_try_peek(&motion_queue[axis], &cmd) && motion_ready(&cmd)) {
+                motion_execute(&cmd);
+                motion_taken[axis] = motion_taken[axis] + 1;
+                queue_try_remove(&motion_queue[axis], &cmd);
+                taken = 1;
+            }
+        }
+        if (!taken) {
+            tight_loop_contents();
+        }
+    }
+}
+
+// motion_halt: stop, abort or pause all the axes, runs on core1. Moves still waiting in motion_queue
+// are dropped by stop and abort.
+void __not_in_flash_func(motion_halt)(uint32_t req) {
+    motion_cmd_t cmd;
+    int op = req & 0xff;
+    int axis;
+    bool ok = true;
+
+    if ((req & MOTION_HALT_MASK) != MOTION_HALT) {
+        return;
+    }
+    switch(op) {
+        case HALT_OP_STOP:
+        case HALT_OP_ABORT:
+            for (axis = 0; axis < NUM_AXES; axis++) {
+                while (queue_try_remove(&motion_queue[axis], &cmd)) {
+                    motion_taken[axis] = motion_taken[axis] + 1;
+                }
+            }
+            if (op == HALT_OP_STOP) {
+                ok = Wheels.stop();
+                ok = Motor3.stop() && ok;
+                ok = Motor4.stop() && ok;
+            } else {
+                ok = Wheels.abort();
+                ok = Motor3.abort() && ok;
+                ok = Motor4.abort() && ok;
+            }
+            break;
+        case HALT_OP_PAUSE:
+            ok = Wheels.pause();
+            ok = Motor3.pause() && ok;
+            ok = Motor4.pause() && ok;
+            break;
+        default:
+            return;
+    }
+    motion_ack(req | (ok ? 0 : MOTION_REFUSED));
+}
+
+// motion_resume: resume all the axes, returns non-zero once they all have. Axes that were not paused
+// carry on as they are.
+int __not_in_flash_func(motion_resume)(void) {
+    bool ok;
+
+    ok = Wheels.resume();
+    ok = Motor3.resume() && ok;
+    ok = Motor4.resume() && ok;
+    return(ok);
+}
+
+// motion_ack: tell core0 that a halt request has been acted on. Core0 only has one request outstanding,
+// so there is always room in the FIFO.
+void __not_in_flash_func(motion_ack)(uint32_t ack) {
+    multicore_fifo_push_timeout_us(ack, 0);
+}
+
+// motion_ready: returns non-zero if the axis of the move has space in its queue. Jog speeds are
+// passed straight on, as they replace the previous ones.
+int __not_in_flash_func(motion_ready)(const motion_cmd_t* cmd) {
+    if ((trig_state == TRIG_ARMED) && (cmd->axis == trig_axis)) {
+        return(0); // the position after a move until trigger is not known until it ends
+    }
+    if ((cmd->axis == AXIS_WHEELS) && (cmd->action == PAIR_JOG)) {
+        return(1);
+    }
+    if ((cmd->axis == AXIS_WHEELS) && (cmd->action == PAIR_GOTO)) {
+        return(!Wheels.busy()); // it is planned from the pose, once the moves before it have run
+    }
+    if (cmd->action == MOTION_SPEED) {
+        // the ramp is rebuilt for the new speed, which waits for the axis to stop
+        switch(cmd->axis) {
+            case AXIS_WHEELS:
+                return(!Wheels.busy());
+            case AXIS_M3:
+                return(!Motor3.busy());
+            case AXIS_M4:
+                return(!Motor4.busy());
+            default:
+                break;
+        }
+        return(1);
+    }
+    if (cmd->action == MOTION_UNTIL) {
+        // the move runs on its own, so the trigger ends nothing but this move, and its result has to be reported
+        if (trig_state != TRIG_IDLE) {
+            return(0);
+        }
+        switch(cmd->axis) {
+            case AXIS_WHEELS:
+                return(!Wheels.busy());
+            case AXIS_M3:
+                return(!Motor3.busy());
+            case AXIS_M4:
+                return(!Motor4.busy());
+            default:
+                break;
+        }
+        return(1);
+    }
+    switch(cmd->axis) {
+        case AXIS_WHEELS:
+            return(Wheels.ready());
+        case AXIS_M3:
+            return(Motor3.ready());
+        case AXIS_M4:
+            return(Motor4.ready());
+        default:
+            break;
+    }
+    return(1);
+}
+
+// motion_execute: queue a move to its axis, runs on core1
+void __not_in_flash_func(motion_execute)(const motion_cmd_t* cmd) {
+    int steps = cmd->value;
+    int dir;
+    bool ok;
+
+    if (cmd->action == MOTION_SPEED) {
+        motion_speed(cmd);
+        return;
+    }
+    motion_feed(cmd);
+    if (cmd->action == MOTION_UNTIL) {
+        motion_until(cmd);
+        return;
+    }
+    if (cmd->axis == AXIS_WHEELS) {
+        if (cmd->action == PAIR_ARC) {
+            ok = Wheels.arc(cmd->value, cmd->value2);
+        } else if (cmd->action == PAIR_LEFT) {
+            ok = Wheels.turn(cmd->value);
+        } else if (cmd->action == PAIR_RIGHT) {
+            ok = Wheels.turn(0 - cmd->value);
+        } else if (cmd->action == PAIR_GOTO) {
+            ok = Wheels.moveTo(cmd->value, cmd->value2);
+        } else if (cmd->action == PAIR_JOG) {
+            ok = Wheels.jog(cmd->value, cmd->value2);
+        } else {
+            ok = Wheels.step(steps, cmd->action);
+        }
+        if (!ok) {
+            printf("error, wheels are busy!\n");
+        }
+        return;
+    }
+    if ((cmd->action == GOTO_M3) || (cmd->action == GOTO_M4)) {
+        // the move is from where the motor will be once its queued moves have completed
+        steps = (int)((int64_t)cmd->value - motor_position((cmd->axis == AXIS_M3) ? 3 : 4, 1));
+    }
+    if (steps<0) {
+        dir = 1;
+        steps = abs(steps);
+    } else {
+        dir = 0;
+    }
+    if (cmd->axis == AXIS_M3) {
+        ok = Motor3.step(steps, dir);
+    } else {
+        ok = Motor4.step(steps, dir);
+    }
+    if (!ok) {
+        printf("error, %s is busy!\n", axis_name[(int)cmd->axis]);
+    }
+}
+
+// motion_speed: set the speed of an axis, runs on core1 once the axis has stopped
+void motion_speed(const motion_cmd_t* cmd) {
+    bool ok;
+
+    switch(cmd->axis) {
+        case AXIS_WHEELS:
+            ok = Wheels.speedMilli(cmd->value);
+            break;
+        case AXIS_M3:
+            ok = Motor3.speedMilli(cmd->value);
+            break;
+        case AXIS_M4:
+            ok = Motor4.speedMilli(cmd->value);
+            break;
+        default:
+            return;
+    }
+    if (!ok) {
+        printf("error, %s speed not set!\n", axis_name[(int)cmd->axis]);
+    }
+}
+
+// motion_feed: set the speed of the move about to be queued, runs on core1
+void __not_in_flash_func(motion_feed)(const motion_cmd_t* cmd) {
+    switch(cmd->axis) {
+        case AXIS_WHEELS:
+            Wheels.feed(cmd->feed);
+            break;
+        case AXIS_M3:
+            Motor3.feed(cmd->feed);
+            break;
+        case AXIS_M4:
+            Motor4.feed(cmd->feed);
+            break;
+        default:
+            break;
+    }
+}
+
+// motion_until: arm the trigger and start the move, runs on core1 so that the GPIO interrupt is taken
+// by the same core as the step alarm it stops. The value is the most steps to move, the sign is the
+// direction (positive is fwd for the wheels and cw for m3 and m4).
+void motion_until(const motion_cmd_t* cmd) {
+    int steps = abs(cmd->value);
+
+    trig_gpio = ((cmd->value2 & TRIG_PIN_MASK) == TRIG_EXT) ? EXT_PIN : BUTTON_PIN;
+    trig_edge = (cmd->value2 & TRIG_RISE) ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+    if (trig_gpio == EXT_PIN) {
+        // the pin is an input for the switch until the ext command drives it again
+        gpio_set_dir(EXT_PIN, GPIO_IN);
+        gpio_pull_up(EXT_PIN);
+    }
+    trig_axis = cmd->axis;
+    trig_state = TRIG_ARMED;
+    gpio_acknowledge_irq(trig_gpio, trig_edge); // forget any edge from before the move
+    gpio_set_irq_enabled_with_callback(trig_gpio, trig_edge, true, trigger_irq);
+    switch(cmd->axis) {
+        case AXIS_WHEELS:
+            Wheels.step(steps, (cmd->value >= 0) ? PAIR_FWD : PAIR_REV);
+            break;
+        case AXIS_M3:
+            Motor3.step(steps, (cmd->value < 0) ? 1 : 0);
+            break;
+        case AXIS_M4:
+            Motor4.step(steps, (cmd->value < 0) ? 1 : 0);
+            break;
+        default:
+            break;
+    }
+}
+
+// trigger_latch: note where the axis of the move until trigger has stopped, on core1
+void __not_in_flash_func(trigger_latch)(char state) {
+    switch(trig_axis) {
+        case AXIS_WHEELS:
+            trig_pos[0] = Wheels.position(0);
+            trig_pos[1] = Wheels.position(1);
+            break;
+        case AXIS_M3:
+            trig_pos[0] = Motor3.position(0);
+            break;
+        case AXIS_M4:
+            trig_pos[0] = Motor4.position(0);
+            break;
+        default:
+            break;
+    }
+    trig_state = state;
+}
+
+// trigger_irq: the edge has arrived, stop the axis without decelerating and latch its position.
+// abort() takes the position back to the step being output, so it is exact on the PIO backend too.
+void __not_in_flash_func(trigger_irq)(uint gpio, uint32_t events) {
+    if ((trig_state != TRIG_ARMED) || (gpio != trig_gpio)) {
+        return;
+    }
+    gpio_set_irq_enabled(gpio, trig_edge, false);
+    switch(trig_axis) {
+        case AXIS_WHEELS:
+            Wheels.abort();
+            break;
+        case AXIS_M3:
+            Motor3.abort();
+            break;
+        case AXIS_M4:
+            Motor4.abort();
+            break;
+        default:
+            break;
+    }
+    trigger_latch(TRIG_HIT);
+}
+
+// trigger_check: if the move has ended (all its steps, or a stop or abort) without the edge, disarm
+// the trigger. Interrupts are off so the edge cannot arrive part way through.
+void __not_in_flash_func(trigger_check)(void) {
+    uint32_t irq;
+    bool moving;
+
+    irq = save_and_disable_interrupts();
+    switch(trig_axis) {
+        case AXIS_WHEELS:
+            moving = Wheels.busy();
+            break;
+        case AXIS_M3:
+            moving = Motor3.busy();
+            break;
+        case AXIS_M4:
+            moving = Motor4.busy();
+            break;
+        default:
+            moving = false;
+            break;
+    }
+    if ((trig_state == TRIG_ARMED) && !moving) {
+        gpio_set_irq_enabled(trig_gpio, trig_edge, false);
+        trigger_latch(TRIG_MISSED);
+    }
+    restore_interrupts(irq);
+}
+
 //*************** other functions ***********************
 
 int init(void) {
+    int i;
+
     gpio_init(PICO_DEFAULT_LED_PIN);
     gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
     gpio_init(DRV_ENA_PIN);
@@ -134,6 +631,7 @@ int init(void) {
     gpio_init(EXT_PIN);
     gpio_set_dir(EXT_PIN, GPIO_OUT);
     gpio_put(DRV_ENA_PIN, 1); // turn on the motor driver modules
+    Servos.add(&Servo);
     stdio_init_all();
     menu_init();
     uart_init(uart0, BAUD);
@@ -141,6 +639,14 @@ int init(void) {
     gpio_set_function(1, GPIO_FUNC_UART);
     alarm_pool = alarm_pool_create(2, 16); // create an alarm pool
     irq_set_priority(TIMER_IRQ_2, 0xc0); // larger number is lower priority
+    // the motors are run by core1, this core is left for the user interface
+    for (i = 0; i < NUM_AXES; i++) {
+        queue_init(&motion_queue[i], sizeof(motion_cmd_t), MOTION_QUEUE_LEN);
+    }
+    multicore_launch_core1(motion_core);
+    while (multicore_fifo_pop_blocking() != MOTION_CORE_READY) {
+        tight_loop_contents();
+    }
 
     sleep_ms(100);
 
@@ -172,11 +678,16 @@ int init(void) {
     return(0);
 }
 
-// rotate_wheels: wheels action, move robot fwd/back/left/right by specified amount value
-// sub_action_type: 0-3 (0=fwd, 1=rev, 2=left, 3=right)
-// value: number of motor steps for fwd or reverse, or angle in degrees for left/right rotation
-void rotate_wheels(char sub_action_type, double value) {
+// rotate_wheels: wheels action, move robot fwd/back/left/right/arc by specified amount value, or jog
+// sub_action_type: 0-6 (0=rev, 1=fwd, 2=left, 3=right, 4=arc, 5=jog, 6=goto)
+// value: number of motor steps for fwd or reverse, angle in milli-degrees for left/right rotation, arc radius
+//        in steps, left wheel speed in rpm for jog, or x in steps for goto
+// value2: arc angle in milli-degrees (positive is left), right wheel speed in rpm for jog, or y in steps for goto
+// feed: speed of the move in thousandths of an rpm, or 0 for the wheel speed (not used by jog)
+// Core1 converts turn angles to steps (see SMotPair::turn), so the rounding is carried from one turn to the next
+void rotate_wheels(char sub_action_type, int32_t value, int32_t value2, int32_t feed) {
     int value_int;
+    char nbuf[16];
     value_int = (int)value;
     switch (sub_action_type) {
         case PAIR_FWD:
@@ -184,10 +695,11 @@ void rotate_wheels(char sub_action_type, double value) {
                 m2m_response((char *)RESP_PROCESSING);
             } else {
                 printf("Move fwd %d\n\r", value_int);
+                report_feed(AXIS_WHEELS, feed);
             }
-            Wheels.step(value_int, PAIR_FWD);
+            motion_send(AXIS_WHEELS, PAIR_FWD, value_int, 0, feed);
             if (menulevel == MENU_M2M) {
-                m2m_response((char *)RESP_OK);
+                m2m_response((char *)RESP_OK); // the move has been queued
             } else {
                 printf("$ ");
             }
@@ -197,10 +709,11 @@ void rotate_wheels(char sub_action_type, double value) {
                 m2m_response((char *)RESP_PROCESSING);
             } else {
                 printf("Move back %d\n\r", value_int);
+                report_feed(AXIS_WHEELS, feed);
             }
-            Wheels.step(value_int, PAIR_REV);
+            motion_send(AXIS_WHEELS, PAIR_REV, value_int, 0, feed);
             if (menulevel == MENU_M2M) {
-                m2m_response((char *)RESP_OK);
+                m2m_response((char *)RESP_OK); // the move has been queued
             } else {
                 printf("$ ");
             }
@@ -209,16 +722,16 @@ void rotate_wheels(char sub_action_type, double value) {
             if (menulevel == MENU_M2M) {
                 m2m_response((char *)RESP_PROCESSING);
             } else {
-                printf("Turn left %d deg\n\r", value);
+                printf("Turn left %s deg\n\r", milli_str(value, nbuf));
+                report_feed(AXIS_WHEELS, feed);
             }
-            value_int = (int)(WHEELSTEPSDEGREE * value); // convert degrees to steps
             if (value_int > 0) {
-                Wheels.step(value_int, PAIR_LEFT);
+                motion_send(AXIS_WHEELS, PAIR_LEFT, value_int, 0, feed);
             } else {
-                Wheels.step(abs(value_int), PAIR_RIGHT);
+                motion_send(AXIS_WHEELS, PAIR_RIGHT, abs(value_int), 0, feed);
             }
             if (menulevel == MENU_M2M) {
-                m2m_response((char *)RESP_OK);
+                m2m_response((char *)RESP_OK); // the move has been queued
             } else {
                 printf("$ ");
             }
@@ -227,14 +740,55 @@ void rotate_wheels(char sub_action_type, double value) {
             if (menulevel == MENU_M2M) {
                 m2m_response((char *)RESP_PROCESSING);
             } else {
-                printf("Turn right %d deg\n\r", value);
+                printf("Turn right %s deg\n\r", milli_str(value, nbuf));
+                report_feed(AXIS_WHEELS, feed);
             }
-            value_int = (int)(WHEELSTEPSDEGREE * value); // convert degrees to steps
             if (value_int > 0) {
-                Wheels.step(value_int, PAIR_RIGHT);
+                motion_send(AXIS_WHEELS, PAIR_RIGHT, value_int, 0, feed);
+            } else {
+                motion_send(AXIS_WHEELS, PAIR_LEFT, abs(value_int), 0, feed);
+            }
+            if (menulevel == MENU_M2M) {
+                m2m_response((char *)RESP_OK); // the move has been queued
+            } else {
+                printf("$ ");
+            }
+            break;
+        case PAIR_ARC:
+            if (menulevel == MENU_M2M) {
+                m2m_response((char *)RESP_PROCESSING);
+            } else {
+                printf("Arc radius %d, %s deg\n\r", value_int, milli_str(value2, nbuf));
+                report_feed(AXIS_WHEELS, feed);
+            }
+            motion_send(AXIS_WHEELS, PAIR_ARC, value_int, (int)value2, feed);
+            if (menulevel == MENU_M2M) {
+                m2m_response((char *)RESP_OK); // the move has been queued
+            } else {
+                printf("$ ");
+            }
+            break;
+        case PAIR_GOTO:
+            if (menulevel == MENU_M2M) {
+                m2m_response((char *)RESP_PROCESSING);
             } else {
-                Wheels.step(abs(value_int), PAIR_LEFT);
+                printf("Go to %d, %d\n\r", value_int, (int)value2);
+                report_feed(AXIS_WHEELS, feed);
             }
+            motion_send(AXIS_WHEELS, PAIR_GOTO, value_int, (int)value2, feed);
+            if (menulevel == MENU_M2M) {
+                m2m_response((char *)RESP_OK); // the move has been queued
+            } else {
+                printf("$ ");
+            }
+            break;
+        case PAIR_JOG:
+            if (menulevel == MENU_M2M) {
+                m2m_response((char *)RESP_PROCESSING);
+            } else {
+                printf("Jog left %d rpm, right %d rpm\n\r", value_int, (int)value2);
+            }
+            motion_send(AXIS_WHEELS, PAIR_JOG, value_int, (int)value2, 0);
             if (menulevel == MENU_M2M) {
                 m2m_response((char *)RESP_OK);
             } else {
@@ -247,14 +801,25 @@ void rotate_wheels(char sub_action_type, double value) {
 
 }
 
-// move_servo: ang is a value in degrees, typically 0-180 (range is defined in hservo.h/hservo.cpp)
-void move_servo(int ang) {
+// move_servo: id is the servo in the bank (0 is the pen), ang is a value in degrees, typically 0-180
+// (range is defined in hservo.h/hservo.cpp)
+void move_servo(int id, int ang) {
+    HServo* servo = Servos.servo(id);
+
+    if (servo == NULL) {
+        if (menulevel == MENU_M2M) {
+            m2m_response((char *)RESP_BADREQ);
+        } else {
+            printf("error, no servo %d!\n\r$ ", id);
+        }
+        return;
+    }
     if (menulevel == MENU_M2M) {
         m2m_response((char *)RESP_PROCESSING);
     } else {
-        printf("Move servo to %d deg\n\r", ang);
+        printf("Move servo %d to %d deg\n\r", id, ang);
     }
-    Servo.setAng(ang);
+    servo->setAng(ang);
     if (menulevel == MENU_M2M) {
         m2m_response((char *)RESP_OK);
     } else {
@@ -262,46 +827,144 @@ void move_servo(int ang) {
     }
 }
 
+// set_servo: output a pulse width in microseconds (SERVO_PULSE), or change the servo calibration: the pulse
+// width range (SERVO_RANGE), a point of the settle time curve (SERVO_SETTLE) or the slew rate (SERVO_SLEW).
+// The servo id is in the upper bits of sub_action_type (see SERVO_ID_SHIFT).
+void set_servo(char sub_action_type, int32_t value, int32_t value2) {
+    int id = sub_action_type >> SERVO_ID_SHIFT;
+    HServo* servo = Servos.servo(id);
+    bool ok = false;
+
+    if (menulevel == MENU_M2M) {
+        m2m_response((char *)RESP_PROCESSING);
+    }
+    if (servo == NULL) {
+        sub_action_type = 0; // not a calibration, so the reply is an error
+        if (menulevel != MENU_M2M) {
+            printf("error, no servo %d!\n\r", id);
+        }
+    }
+    switch(sub_action_type & SERVO_OP_MASK) {
+        case SERVO_PULSE:
+            if (menulevel != MENU_M2M) {
+                printf("Servo %d pulse %ld us\n\r", id, (long)value);
+            }
+            ok = servo->setPulse(value);
+            break;
+        case SERVO_RANGE:
+            if (menulevel != MENU_M2M) {
+                printf("Servo %d pulse range %ld to %ld us\n\r", id, (long)value, (long)value2);
+            }
+            ok = servo->range(value, value2);
+            break;
+        case SERVO_SETTLE:
+            if (menulevel != MENU_M2M) {
+                printf("Servo %d takes %ld ms to move %ld deg\n\r", id, (long)value2, (long)value);
+            }
+            ok = servo->settle(value, value2);
+            break;
+        case SERVO_SLEW:
+            if (menulevel != MENU_M2M) {
+                printf("Servo %d slew %ld deg/s\n\r", id, (long)value);
+            }
+            ok = servo->slew(value);
+            break;
+        default:
+            break;
+    }
+    if (menulevel == MENU_M2M) {
+        m2m_response(ok ? (char *)RESP_OK : (char *)RESP_BADREQ);
+    } else {
+        printf("$ ");
+    }
+}
+
+// motor_position: position of M3 or M4 in steps, in the same sense as the m3/m4 commands (positive is cw,
+// which is motor direction 0). If queued is non-zero, it is the position once the queued moves have completed,
+// this is only called on core1 as the moves are queued there.
+int64_t motor_position(int motornum, int queued) {
+    if (queued) {
+        return(0 - ((motornum == 3) ? Motor3.target(0) : Motor4.target(0)));
+    }
+    return(0 - ((motornum == 3) ? Motor3.position(0) : Motor4.position(0)));
+}
+
 // rotate_motor
-void rotate_motor(char sub_action_type, double value) {
+// sub_action_type: ROT_M3/ROT_M4 to move by value steps, or GOTO_M3/GOTO_M4 to move to absolute position value
+// feed: speed of the move in thousandths of an rpm, or 0 for the motor speed
+void rotate_motor(char sub_action_type, int32_t value, int32_t feed) {
     int motornum=0;
-    int dir=0;
     int steps = (int)value;
     switch (sub_action_type) {
         case ROT_M3:
+        case GOTO_M3:
             motornum = 3;
             break;
         case ROT_M4:
+        case GOTO_M4:
             motornum = 4;
             break;
         default:
-            break;
+            return;
     }
     if (menulevel == MENU_M2M) {
         m2m_response((char *)RESP_PROCESSING);
+    } else if ((sub_action_type == GOTO_M3) || (sub_action_type == GOTO_M4)) {
+        printf("Move m%d to %d\n\r", motornum, steps);
     } else {
         printf("Rotate m%d %d steps\n\r", motornum, steps);
     }
-    if (steps<0) {
-        dir = 1;
-        steps = abs(steps);
+    if (menulevel != MENU_M2M) {
+        report_feed((motornum == 3) ? AXIS_M3 : AXIS_M4, feed);
+    }
+    // core1 works out the steps for a goto, once the moves queued before it are known
+    motion_send((motornum == 3) ? AXIS_M3 : AXIS_M4, sub_action_type, steps, 0, feed);
+    if (menulevel == MENU_M2M) {
+        m2m_response((char *)RESP_OK); // the move has been queued
     } else {
-        dir = 0;
+        printf("$ ");
     }
-    switch(motornum) {
-        case 3:
-            Motor3.step(steps, dir);
-            break;
-        case 4:
-            Motor4.step(steps, dir);
-            break;
-        default:
-            break;
+}
+
+// report_pos: report the current absolute position of M3 or M4, or the pose of the wheels
+void report_pos(char sub_action_type) {
+    int motornum = (sub_action_type == ROT_M3) ? 3 : 4;
+    char buf[64];
+    char nbuf[16];
+    int64_t x;
+    int64_t y;
+    int32_t heading;
+
+    if (sub_action_type == POS_WHEELS) {
+        Wheels.pose(&x, &y, &heading);
+        if (menulevel == MENU_M2M) {
+            sprintf(buf, "PW %lld %lld %ld\n\r", (long long)x, (long long)y, (long)heading);
+            m2m_response(buf);
+        } else {
+            printf("wheels are at %lld, %lld steps, heading %s deg\n\r$ ", (long long)x, (long long)y,
+                   milli_str(heading, nbuf));
+        }
+        return;
     }
     if (menulevel == MENU_M2M) {
-        m2m_response((char *)RESP_OK);
+        sprintf(buf, "PS %lld\n\r", (long long)motor_position(motornum, 0));
+        m2m_response(buf);
     } else {
-        printf("$ ");
+        printf("m%d is at %lld steps\n\r$ ", motornum, (long long)motor_position(motornum, 0));
+    }
+}
+
+// report_coils: report the total time the coils of each axis have been energized, in milliseconds
+void report_coils(void) {
+    char buf[64];
+
+    if (menulevel == MENU_M2M) {
+        sprintf(buf, "EN %llu %llu %llu\n\r", (unsigned long long)Wheels.energized(),
+                (unsigned long long)Motor3.energized(), (unsigned long long)Motor4.energized());
+        m2m_response(buf);
+    } else {
+        printf("coils energized: wheels %llu ms, m3 %llu ms, m4 %llu ms\n\r$ ", (unsigned long long)Wheels.energized(),
+               (unsigned long long)Motor3.energized(), (unsigned long long)Motor4.energized());
     }
 }
 
@@ -313,6 +976,7 @@ void ext_pwr(char subaction)
     } else {
         printf("Setting ext power state %d\n\r", subaction);
     }
+    gpio_set_dir(EXT_PIN, GPIO_OUT); // in case a move until trigger used it as an input
     switch(subaction) {
         case EXT_ON:
             EXT_PWR_ON;
@@ -328,54 +992,382 @@ void ext_pwr(char subaction)
     }
 }
 
-// handle_requests
+// motion_send: send a move to core1, the caller checks there is space first (see request_ready)
+void motion_send(char axis, char action, int value, int value2, int feed) {
+    motion_cmd_t cmd;
+
+    cmd.axis = axis;
+    cmd.action = action;
+    cmd.value = value;
+    cmd.value2 = value2;
+    cmd.feed = feed;
+    motion_sent[(int)axis] = motion_sent[(int)axis] + 1;
+    if (!queue_try_add(&motion_queue[(int)axis], &cmd)) {
+        motion_sent[(int)axis] = motion_sent[(int)axis] - 1;
+        printf("error, motion queue full!\n");
+    }
+}
+
+// axis_busy: returns non-zero if the axis has moves waiting for core1, or is still moving
+int axis_busy(int axis) {
+    if (motion_sent[axis] != motion_taken[axis]) {
+        return(1);
+    }
+    switch(axis) {
+        case AXIS_WHEELS:
+            return(Wheels.busy());
+        case AXIS_M3:
+            return(Motor3.busy());
+        case AXIS_M4:
+            return(Motor4.busy());
+        default:
+            break;
+    }
+    return(0);
+}
+
+// motion_busy: returns non-zero if any of the motors is still moving
+int motion_busy(void) {
+    return(axis_busy(AXIS_WHEELS) || axis_busy(AXIS_M3) || axis_busy(AXIS_M4));
+}
+
+// wait_motion: block until all the queued moves have completed
+void wait_motion(void) {
+    while (motion_busy()) {
+        sleep_ms(1);
+    }
+}
+
+// axis_done_callback: runs in interrupt context when an axis has no more moves, ctx is its axis_done flag
+void axis_done_callback(void* ctx) {
+    *((volatile char*)ctx) = 1;
+}
+
+// report_done: report each axis that has completed its moves since the last check
+void report_done(void) {
+    int i;
+
+    for (i=0; i<NUM_AXES; i++) {
+        if (axis_done[i]) {
+            axis_done[i] = 0;
+            if (menulevel == MENU_M2M) {
+                m2m_response((char *)axis_resp[i]);
+            } else {
+                printf("%s done\n\r$ ", axis_name[i]);
+            }
+        }
+    }
+}
+
+// request_halt: send a HALT_OP_* to core1 straight away, called by the parser. The result is reported
+// by report_halt() once the motors have come to rest. Stop and abort also drop the requests queued so far.
+void request_halt(char op) {
+    if (menulevel == MENU_M2M) {
+        m2m_response((char *)RESP_PROCESSING);
+    }
+    if (halt_op != 0) {
+        if (menulevel == MENU_M2M) {
+            m2m_response((char *)RESP_BUSY);
+        } else {
+            printf("busy, previous halt request not complete\n\r$ ");
+        }
+        return;
+    }
+    if ((op == HALT_OP_STOP) || (op == HALT_OP_ABORT)) {
+        ui_drop_to = UiQueue.pushed();
+        ui_drop = 1;
+        if (trig_button) {
+            trig_button = 2; // a move until the button may be dropped before it starts
+        }
+    }
+    halt_ack = 0;
+    halt_op = op;
+    halt_sent_us = to_us_since_boot(get_absolute_time());
+    multicore_fifo_push_timeout_us(MOTION_HALT | op, 0); // core1 has no other requests outstanding
+}
+
+// halt_at_rest: returns non-zero once every axis has stopped, or paused if paused is non-zero
+int halt_at_rest(int paused) {
+    if (paused) {
+        return((!Wheels.busy() || Wheels.paused()) && (!Motor3.busy() || Motor3.paused()) &&
+               (!Motor4.busy() || Motor4.paused()));
+    }
+    return(!motion_busy());
+}
+
+// halt_latency: time from sending a halt request to the last axis acting on it, in microseconds
+uint64_t halt_latency(void) {
+    uint64_t t = Wheels.halted();
+
+    if (Motor3.halted() > t) {
+        t = Motor3.halted();
+    }
+    if (Motor4.halted() > t) {
+        t = Motor4.halted();
+    }
+    return((t > halt_sent_us) ? t - halt_sent_us : 0);
+}
+
+// report_halt: report the steps each axis has left and the latency of a stop, abort or pause, once core1
+// has acted on it and the motors have come to rest. The steps left are what was dropped for a stop or an
+// abort, and what resume will issue for a pause.
+void report_halt(void) {
+    char buf[80];
+    long long left;
+    long long right;
+    uint64_t latency;
+    const char* what;
+
+    while (multicore_fifo_rvalid()) {
+        halt_ack = multicore_fifo_pop_blocking();
+    }
+    if ((halt_op == 0) || (halt_ack == 0)) {
+        return;
+    }
+    if ((halt_op != HALT_OP_ABORT) && (halt_op != HALT_OP_RESUME) && !halt_at_rest(halt_op == HALT_OP_PAUSE)) {
+        return; // still slowing down
+    }
+    if (halt_ack & MOTION_REFUSED) {
+        // an axis did not take the halt request
+        if (menulevel != MENU_M2M) {
+            printf("error, a wheel move in progress could not be halted!\n\r");
+        }
+    }
+    if (halt_op == HALT_OP_RESUME) {
+        if (menulevel == MENU_M2M) {
+            m2m_response((char *)RESP_OK);
+        } else {
+            printf("resumed\n\r$ ");
+        }
+        halt_op = 0;
+        return;
+    }
+    // in the same sense as the fwd and m3/m4 commands
+    right = (long long)Wheels.remaining(0);
+    left = 0 - (long long)Wheels.remaining(1);
+    latency = halt_latency();
+    if (menulevel == MENU_M2M) {
+        sprintf(buf, "RM %lld %lld %lld %lld %llu\n\r", left, right, 0 - (long long)Motor3.remaining(0),
+                0 - (long long)Motor4.remaining(0), (unsigned long long)latency);
+        m2m_response(buf);
+        m2m_response((char *)RESP_OK);
+    } else {
+        what = (halt_op == HALT_OP_STOP) ? "stopped" : ((halt_op == HALT_OP_ABORT) ? "aborted" : "paused");
+        printf("%s after %llu us, steps left: wheels %lld %lld, m3 %lld, m4 %lld\n\r", what,
+               (unsigned long long)latency, left, right, 0 - (long long)Motor3.remaining(0),
+               0 - (long long)Motor4.remaining(0));
+        if (program_paused()) {
+            printf("program paused after line %d\n\r", program_line());
+        }
+        printf("$ ");
+    }
+    halt_op = 0;
+}
+
+// move_until: move an axis (SEL_*) by up to value steps until the trigger (TRIG_*) in value2,
+// report_trigger() reports where it stopped
+void move_until(char axis, int32_t value, int32_t value2, int32_t feed) {
+    int trig = (int)value2;
+    int steps = (int)value;
+    char motion_axis = (axis == SEL_M3) ? AXIS_M3 : ((axis == SEL_M4) ? AXIS_M4 : AXIS_WHEELS);
+
+    if (menulevel == MENU_M2M) {
+        m2m_response((char *)RESP_PROCESSING);
+    } else {
+        printf("Move %s up to %d steps until the %s pin %s\n\r", axis_name[(int)motion_axis], steps,
+               ((trig & TRIG_PIN_MASK) == TRIG_EXT) ? "ext" : "button", (trig & TRIG_RISE) ? "rises" : "falls");
+        report_feed(motion_axis, feed);
+    }
+    if ((trig & TRIG_PIN_MASK) == TRIG_BUTTON) {
+        trig_button = 1;
+    }
+    motion_send(motion_axis, MOTION_UNTIL, steps, trig, feed);
+    if (menulevel == MENU_M2M) {
+        m2m_response((char *)RESP_OK); // the move has been queued
+    } else {
+        printf("$ ");
+    }
+}
+
+// set_speed: set the speed of an axis (SEL_*) in thousandths of an rpm. Core1 applies it once the moves queued
+// before it have completed, as the acceleration ramp is rebuilt for the new speed.
+void set_speed(char axis, int32_t mrpm) {
+    char motion_axis = (axis == SEL_M3) ? AXIS_M3 : ((axis == SEL_M4) ? AXIS_M4 : AXIS_WHEELS);
+    char nbuf[16];
+
+    if (menulevel == MENU_M2M) {
+        m2m_response((char *)RESP_PROCESSING);
+    } else {
+        printf("Set %s speed to %s rpm\n\r", axis_name[(int)motion_axis], milli_str(mrpm, nbuf));
+    }
+    motion_send(motion_axis, MOTION_SPEED, mrpm, 0, 0);
+    if (menulevel == MENU_M2M) {
+        m2m_response((char *)RESP_OK); // the change has been queued
+    } else {
+        printf("$ ");
+    }
+}
+
+// report_feed: print the speed of a move with an @ suffix. The acceleration ramp is built for the axis
+// speed, so a move can only be slower than that.
+void report_feed(int axis, int32_t mrpm) {
+    long limit;
+    char nbuf[16];
+
+    if (mrpm <= 0) {
+        return;
+    }
+    limit = (axis == AXIS_WHEELS) ? Wheels.rpmMilli() : ((axis == AXIS_M3) ? Motor3.rpmMilli() : Motor4.rpmMilli());
+    if (mrpm >= limit) {
+        printf("  at the %s speed of %s rpm\n\r", axis_name[axis], milli_str(limit, nbuf));
+    } else {
+        printf("  at %s rpm\n\r", milli_str(mrpm, nbuf));
+    }
+}
+
+// report_trigger: report the position latched by a move until trigger, in the same sense as the fwd and
+// m3/m4 commands, or that the move ended without the edge
+void report_trigger(void) {
+    char buf[48];
+    long long pos;
+    int hit;
+
+    if ((trig_state != TRIG_HIT) && (trig_state != TRIG_MISSED)) {
+        return;
+    }
+    hit = (trig_state == TRIG_HIT);
+    pos = (trig_axis == AXIS_WHEELS) ? (long long)trig_pos[0] : 0 - (long long)trig_pos[0];
+    if (menulevel == MENU_M2M) {
+        if (trig_axis == AXIS_WHEELS) {
+            sprintf(buf, "%s %lld %lld\n\r", hit ? "TR" : "TN", 0 - (long long)trig_pos[1], pos);
+        } else {
+            sprintf(buf, "%s %lld\n\r", hit ? "TR" : "TN", pos);
+        }
+        m2m_response(buf);
+    } else if (trig_axis == AXIS_WHEELS) {
+        printf("wheels %s at left %lld, right %lld steps\n\r$ ", hit ? "triggered" : "not triggered, stopped",
+               0 - (long long)trig_pos[1], pos);
+    } else {
+        printf("%s %s at %lld steps\n\r$ ", axis_name[trig_axis], hit ? "triggered" : "not triggered, stopped", pos);
+    }
+    if (trig_button) {
+        trig_button = 2;
+    }
+    trig_state = TRIG_IDLE; // core1 can take the next move until trigger
+}
+
+// request_ready: returns non-zero if the pending request can be actioned now. Moves wait for space in
+// the queue of their axis to core1, which passes them on to the axis as it has space. The pen (servo) waits for
+// the wheels to complete their moves, and wheel moves wait for the pen to finish moving (the servo moves
+// on its own, see HServo::ready). The external power waits for all the axes.
+int request_ready(const ui_cmd_t* cmd) {
+    switch(cmd->action) {
+        case ACTION_WHEELS:
+            return(!queue_is_full(&motion_queue[AXIS_WHEELS]) && Servo.ready());
+        case ACTION_UNTIL:
+            if ((cmd->sub_action == SEL_WHEELS) && !Servo.ready()) {
+                return(0);
+            }
+            return(!queue_is_full(&motion_queue[request_axis(cmd)]));
+        case ACTION_MOTOR:
+        case ACTION_SPEED:
+            return(!queue_is_full(&motion_queue[request_axis(cmd)]));
+        case ACTION_SERVO:
+            return(!axis_busy(AXIS_WHEELS));
+        case ACTION_EXT:
+            return(!motion_busy());
+        default:
+            break;
+    }
+    return(1);
+}
+
+// request_axis: the axis (AXIS_*) that a wheels, motor, until or speed request is sent to
+int request_axis(const ui_cmd_t* cmd) {
+    switch(cmd->action) {
+        case ACTION_MOTOR:
+            return(((cmd->sub_action == ROT_M3) || (cmd->sub_action == GOTO_M3)) ? AXIS_M3 : AXIS_M4);
+        case ACTION_UNTIL:
+        case ACTION_SPEED:
+            return((cmd->sub_action == SEL_M3) ? AXIS_M3 : ((cmd->sub_action == SEL_M4) ? AXIS_M4 : AXIS_WHEELS));
+        default:
+            break;
+    }
+    return(AXIS_WHEELS);
+}
+
+// handle_requests: action the queued requests in order, until one has to wait
 void handle_requests(void) {
-    if (modechange)
-    {
-        switch(uiparam_doaction) {
+    ui_cmd_t* cmd;
+
+    report_done();
+    report_halt();
+    report_trigger();
+    if (ui_drop) {
+        // requests queued before a stop or abort are dropped
+        ui_drop = 0;
+        while ((int32_t)(ui_drop_to - UiQueue.popped()) > 0) {
+            UiQueue.pop();
+        }
+    }
+    while ((cmd = UiQueue.peek()) != NULL) {
+        if (!request_ready(cmd)) {
+            return; // the request stays at the front of the queue until it can be actioned
+        }
+        switch(cmd->action) {
             case ACTION_WHEELS:
-                rotate_wheels(uiparam_wheelsaction, uiparam_valueparam);
+                rotate_wheels(cmd->sub_action, cmd->value, cmd->value2, cmd->feed);
                 break;
             case ACTION_SERVO:
-                move_servo((int)uiparam_valueparam);
+                if ((cmd->sub_action & SERVO_OP_MASK) == SERVO_ANG) {
+                    move_servo(cmd->sub_action >> SERVO_ID_SHIFT, (int)cmd->value);
+                } else {
+                    set_servo(cmd->sub_action, cmd->value, cmd->value2);
+                }
                 break;
             case ACTION_MOTOR:
-                rotate_motor(uiparam_motoraction, uiparam_valueparam);
+                rotate_motor(cmd->sub_action, cmd->value, cmd->feed);
                 break;
             case ACTION_EXT:
-                ext_pwr(uiparam_extaction);
+                ext_pwr(cmd->sub_action);
+                break;
+            case ACTION_POS:
+                report_pos(cmd->sub_action);
+                break;
+            case ACTION_COILS:
+                report_coils();
+                break;
+            case ACTION_UNTIL:
+                move_until(cmd->sub_action, cmd->value, cmd->value2, cmd->feed);
+                break;
+            case ACTION_SPEED:
+                set_speed(cmd->sub_action, cmd->value);
                 break;
             default:
                 break;
         }
-        modechange=0;
+        UiQueue.pop();
     }
 }
 
 // run_program
-// currently runs a preset program, but could be modified in future to run user programs
+// currently runs a preset program, but could be modified in future to run user programs.
+// The lines are parsed by the user interface alarm as the request queue has room, so stop, abort,
+// pause and resume can still be typed while the program runs.
 void run_program(void) {
-    char* line;
-    int i=0;
-
     if (menulevel == MENU_M2M) {
         m2m_response((char *)RESP_PROCESSING);
     } else {
         printf("running preset program\n\r");
     }
-    
-    line = (char*)preset_program1[0]; // first line
-    while(line[0]!='\0')
-    {
-        if (menulevel == MENU_M2M) {
-            //
-        } else {
-            printf("cmd: %s\n\r", line);
+
+    program_start(preset_program1);
+    while (program_running() || !UiQueue.empty() || motion_busy() || (halt_op != 0)) {
+        sleep_ms(1);
+        if (ui_alarm_id <= 0) {
+            program_poll(); // no user interface alarm, feed the lines from here
         }
-        process_line(line);
-        handle_requests(); // execute any request that resulted from the line
-        i++;
-        line=(char*)preset_program1[i]; // next line
+        handle_requests();
     }
 
     // finished
@@ -0,0 +1,193 @@
+/******************************************************
+ * planner.cpp
+ * Look-ahead Motion Planner
+ * ****************************************************/
+
+#include "planner.h"
+#include "stdio.h"
+#include "hardware/sync.h"
+#include "fixtrig.h"
+#include <cstdlib>
+
+Planner::Planner() {
+    int i;
+
+    mHead = 0;
+    mRun = 0;
+    mActive = false;
+    mPrevCap = RAMP_MAX;
+    for (i=0; i<PLAN_AXES; i++) {
+        mPrev[i] = 0;
+    }
+}
+
+bool Planner::ready(void) {
+    return((mHead - mRun) < PLAN_SLOTS);
+}
+
+bool Planner::empty(void) {
+    return((mHead == mRun) && !mActive);
+}
+
+// junction_scale: copy the steps of a move, shifted so that the largest is 2^13 to 2^14 - 1. The
+// direction is kept, and the products in junction_limit fit in 64 bits. Returns false for no move.
+static bool junction_scale(const int* steps, int64_t* out) {
+    int64_t top = 0;
+    int shift = 0;
+    int i;
+
+    for (i=0; i<PLAN_AXES; i++) {
+        out[i] = steps[i];
+        if (llabs(out[i]) > top) {
+            top = llabs(out[i]);
+        }
+    }
+    if (top == 0) {
+        return(false);
+    }
+    while (top < (1 << 13)) {
+        top = top << 1;
+        shift++;
+    }
+    while (top >= (1 << 14)) {
+        top = top >> 1;
+        shift--;
+    }
+    for (i=0; i<PLAN_AXES; i++) {
+        out[i] = (shift >= 0) ? out[i] * ((int64_t)1 << shift) : out[i] / ((int64_t)1 << (0 - shift));
+    }
+    return(true);
+}
+
+// junction_limit: fastest junction speed (as a ramp position) between moves along vectors p and v.
+// GRBL's junction deviation gives v^2 = a * d * s / (1 - s), where s = sin(theta/2) and theta is the angle
+// between the moves. A ramp position is v^2 / 2a, so the acceleration drops out.
+// The math is all integer, s is Q16.
+static uint32_t junction_limit(const int* p, const int* v) {
+    int64_t a[PLAN_AXES];
+    int64_t b[PLAN_AXES];
+    uint64_t an = 0;
+    uint64_t bn = 0;
+    uint64_t nn;
+    int64_t dot = 0;
+    int64_t c;
+    int64_t s;
+    int64_t k;
+    int i;
+
+    if (!junction_scale(p, a) || !junction_scale(v, b)) {
+        return(0);
+    }
+    for (i=0; i<PLAN_AXES; i++) {
+        an += (uint64_t)(a[i] * a[i]);
+        bn += (uint64_t)(b[i] * b[i]);
+        dot += a[i] * b[i];
+    }
+    nn = fix_sqrt(an * bn); // |a| * |b|, each under 2^15
+    c = dot * 65536 / (int64_t)nn; // cos(theta) in Q16
+    if (c > 65536) {
+        c = 65536;
+    } else if (c < -65536) {
+        c = -65536;
+    }
+    s = ramp_sqrt_q16((uint64_t)(65536 + c) << 15); // sqrt((1 + cos) / 2), the Q32 fraction gives Q16
+    if (s * 1000 > 999 * 65536) {
+        return(RAMP_MAX); // straight on, no need to slow down
+    }
+    k = PLAN_DEVIATION * s / (2 * (65536 - s));
+    if (k >= RAMP_MAX) {
+        return(RAMP_MAX);
+    }
+    return((uint32_t)k);
+}
+
+bool Planner::add(const int* steps, int axes, uint32_t feed, uint32_t cap) {
+    plan_seg_t add;
+    uint32_t irq;
+    int i;
+
+    if ((axes < 1) || (axes > PLAN_AXES)) {
+        printf("error, too many axes!\n");
+        return(false);
+    }
+    if (!ready()) {
+        return(false);
+    }
+    add.len = 0;
+    for (i=0; i<PLAN_AXES; i++) {
+        add.steps[i] = (i < axes) ? steps[i] : 0;
+        if ((uint32_t)abs(add.steps[i]) > add.len) {
+            add.len = abs(add.steps[i]);
+        }
+    }
+    add.junction = junction_limit(mPrev, add.steps);
+    add.entry = 0;
+    add.exit = 0;
+    add.feed = feed;
+    add.cap = cap;
+    // the junction is no faster than either move it joins
+    if (add.junction > cap) {
+        add.junction = cap;
+    }
+
+    // the queue can be cleared from interrupt context, so the slot is only written with interrupts disabled
+    irq = save_and_disable_interrupts();
+    if (empty()) {
+        add.junction = 0; // the motor is at rest
+    } else if (add.junction > mPrevCap) {
+        add.junction = mPrevCap;
+    }
+    mSlots[mHead & (PLAN_SLOTS - 1)] = add;
+    for (i=0; i<PLAN_AXES; i++) {
+        mPrev[i] = add.steps[i];
+    }
+    mPrevCap = cap;
+    mHead = mHead + 1;
+    replan();
+    restore_interrupts(irq);
+    return(true);
+}
+
+plan_seg_t* __not_in_flash_func(Planner::next)(void) {
+    if (mActive) {
+        mRun = mRun + 1;
+        mActive = false;
+    }
+    if (mRun == mHead) {
+        return(NULL);
+    }
+    mActive = true;
+    return(&mSlots[mRun & (PLAN_SLOTS - 1)]);
+}
+
+void Planner::clear(void) {
+    int i;
+
+    mHead = mRun + (mActive ? 1 : 0);
+    mPrevCap = RAMP_MAX;
+    for (i=0; i<PLAN_AXES; i++) {
+        mPrev[i] = 0;
+    }
+}
+
+// replan: recompute the entry and exit speeds, working back from the last segment (which must be able
+// to stop). Each segment can change speed by at most its own length in ramp positions.
+// The motor clamps each entry to the speed it actually reached, so no forward pass is needed here.
+void Planner::replan(void) {
+    uint32_t i = mHead;
+    uint32_t first = mRun + (mActive ? 1 : 0);
+    uint32_t next_entry = 0;
+    plan_seg_t* seg;
+
+    while (i != first) {
+        i--;
+        seg = &mSlots[i & (PLAN_SLOTS - 1)];
+        seg->exit = next_entry;
+        seg->entry = (seg->junction < next_entry + seg->len) ? seg->junction : next_entry + seg->len;
+        next_entry = seg->entry;
+    }
+    if (mActive) {
+        // the motor only picks this up if it has not started decelerating yet
+        mSlots[mRun & (PLAN_SLOTS - 1)].exit = next_entry;
+    }
+}
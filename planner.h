@@ -0,0 +1,60 @@
+#ifndef __PLANNER_H_FILE__
+#define __PLANNER_H_FILE__
+
+// planner.h
+// Look-ahead motion planner. Moves are queued in a fixed ring of segments, and the speed at each
+// junction between consecutive segments is planned (GRBL-style junction deviation) so that moves in
+// the same or a similar direction flow into each other instead of stopping in between.
+// Speeds are held as positions on the motor's acceleration ramp (see profile.h): the number of steps it
+// takes to accelerate from rest to that speed. A motor starts a segment part way up its ramp (entry)
+// and stops decelerating part way down it (exit).
+
+#include "pico/stdlib.h"
+#include "profile.h"
+
+#define PLAN_SLOTS 16 // segments buffered by each planner, including the one being executed. Must be a power of 2.
+#define PLAN_DEVIATION 8 // junction deviation in steps, larger values take corners faster
+#define PLAN_AXES 4 // most motors in one segment
+
+// one queued move of up to PLAN_AXES motors
+typedef struct plan_seg_s {
+    int steps[PLAN_AXES]; // signed step counts of each motor
+    uint32_t len; // the larger step count, i.e. the number of ticks in the move
+    uint32_t junction; // fastest entry allowed by the change of direction from the previous segment
+    uint32_t entry; // planned entry speed, as a ramp position
+    volatile uint32_t exit; // planned exit speed, can be raised while the segment is being executed
+    uint32_t feed; // cruise interval of this move in 1/256 microseconds, or 0 for the motor's speed
+    uint32_t cap; // ramp position of the feed speed, the entry and exit are no faster than this
+} plan_seg_t;
+
+class Planner {
+    public:
+        Planner();
+        // Add a move of axes motors to the end of the queue. Returns false if the queue is full.
+        // Called from the main loop, the junction speeds are replanned with interrupts disabled.
+        // A move slower than the motor's speed has its cruise interval in feed, and the ramp position
+        // of that speed in cap (see Ramp::reach).
+        bool add(const int* steps, int axes, uint32_t feed = 0, uint32_t cap = RAMP_MAX);
+        // Returns true if another move can be added
+        bool ready(void);
+        // Returns true if no moves are queued or being executed
+        bool empty(void);
+        // Called by the motor from interrupt context when it completes a segment (or to start one when idle).
+        // Returns the next segment to execute, or NULL if the queue is empty. The segment stays valid until
+        // the next call.
+        plan_seg_t* next(void);
+        // Drop the queued segments. The one being executed (if any) stays until the next call to next().
+        // Called from interrupt context, or with interrupts disabled.
+        void clear(void);
+
+    private:
+        void replan(void);
+        plan_seg_t mSlots[PLAN_SLOTS];
+        volatile uint32_t mHead; // count of segments added
+        volatile uint32_t mRun; // count of segments completed, the executing segment is mSlots[mRun] when mActive
+        volatile bool mActive;
+        int mPrev[PLAN_AXES]; // steps of the last segment added, for the junction with the next one
+        uint32_t mPrevCap; // speed cap of the last segment added
+};
+
+#endif // __PLANNER_H_FILE__
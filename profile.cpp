@@ -0,0 +1,100 @@
+/******************************************************
+ * profile.cpp
+ * Acceleration Profiles
+ * ****************************************************/
+
+#include "profile.h"
+
+static constexpr RampShape trap_shape = ramp_trap_shape();
+static constexpr RampShape scurve_shape = ramp_scurve_shape();
+
+static_assert(trap_shape.v[RAMP_SHAPE_POINTS] == 65536, "trapezoidal shape must end at full speed");
+static_assert(scurve_shape.v[RAMP_SHAPE_POINTS] >= 65535, "S-curve shape must end at full speed");
+
+Ramp::Ramp() {
+    mLen = 0;
+    mCruise = 0;
+}
+
+void Ramp::build(int type, uint32_t cruise, uint32_t accel) {
+    const RampShape* shape;
+    uint64_t vmax; // steps per second, Q8
+    uint64_t len_q8; // ramp length in steps, Q8
+    uint64_t x;
+    uint32_t idx;
+    uint32_t frac;
+    uint32_t v;
+    uint32_t i;
+
+    mCruise = cruise;
+    mLen = 0;
+    if ((type == PROFILE_NONE) || (accel == 0) || (cruise == 0)) {
+        return;
+    }
+    shape = (type == PROFILE_SCURVE) ? &scurve_shape : &trap_shape;
+    vmax = (1000000ULL << (8 + RAMP_FRAC_BITS)) / cruise;
+    // ramp length: v^2/2a for constant acceleration, 3v^2/4a for the S-curve
+    if (type == PROFILE_SCURVE) {
+        len_q8 = ((vmax * vmax * 3) / (4 * (uint64_t)accel)) >> 8;
+    } else {
+        len_q8 = ((vmax * vmax) / (2 * (uint64_t)accel)) >> 8;
+    }
+    if (len_q8 < 256) {
+        return; // cruise speed is reached within one step
+    }
+    if (len_q8 > ((uint64_t)RAMP_MAX << 8)) {
+        len_q8 = (uint64_t)RAMP_MAX << 8; // acceleration is raised so the ramp fits the table
+    }
+    mLen = (uint32_t)((len_q8 + 255) >> 8);
+    if (mLen > RAMP_MAX) {
+        mLen = RAMP_MAX;
+    }
+    for (i=0; i<mLen; i++) {
+        // velocity halfway through step i, interpolated from the shape table
+        x = (((uint64_t)(2 * i + 1)) << 39) / len_q8; // position as a Q32 fraction of the ramp
+        if (x > (1ULL << 32)) {
+            x = 1ULL << 32;
+        }
+        x = (uint64_t)ramp_sqrt_q16(x) * RAMP_SHAPE_POINTS; // Q16 table position
+        idx = (uint32_t)(x >> 16);
+        frac = (uint32_t)(x & 0xffff);
+        if (idx >= RAMP_SHAPE_POINTS) {
+            v = shape->v[RAMP_SHAPE_POINTS];
+        } else {
+            v = shape->v[idx] + (uint32_t)(((uint64_t)(shape->v[idx + 1] - shape->v[idx]) * frac) >> 16);
+        }
+        if (v < 64) {
+            v = 64; // never slower than 1/1024 of cruise speed
+        }
+        x = ((uint64_t)cruise << 16) / v;
+        mTable[i] = (x > 0xffffffffULL) ? 0xffffffffUL : (uint32_t)x;
+    }
+}
+
+uint32_t Ramp::length(void) {
+    return(mLen);
+}
+
+uint32_t Ramp::reach(uint32_t interval) {
+    uint32_t lo = 0;
+    uint32_t hi = mLen;
+    uint32_t mid;
+
+    if (interval <= mCruise) {
+        return(mLen);
+    }
+    // the intervals fall along the ramp, find the first one at or below interval
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (mTable[mid] <= interval) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return((lo < mLen) ? lo + 1 : mLen);
+}
+
+uint32_t Ramp::cruise(void) {
+    return(mCruise);
+}
@@ -0,0 +1,108 @@
+#ifndef __PROFILE_H_FILE__
+#define __PROFILE_H_FILE__
+
+// profile.h
+// Acceleration profiles. The velocity curve shapes are computed at compile time, and a Ramp
+// turns one into a table of step intervals whenever the speed or acceleration changes, so the
+// step code only has to look the next interval up.
+
+#include <stdint.h>
+
+#define PROFILE_NONE 0 // start and stop at full speed
+#define PROFILE_TRAP 1 // trapezoidal, constant acceleration
+#define PROFILE_SCURVE 2 // S-curve, jerk-limited (acceleration rises and falls smoothly)
+
+#define RAMP_MAX 512 // longest ramp, in steps. Longer ramps are shortened by raising the acceleration.
+#define RAMP_SHAPE_POINTS 64 // resolution of the shape tables
+#define RAMP_FRAC_BITS 8 // intervals are fixed point, in 1/256 microseconds
+
+// velocity (as a Q16 fraction of cruise speed) against the square root of position (as a fraction
+// of the ramp length). Indexing by the square root keeps the points dense where the speed changes
+// fastest, near the start of the ramp.
+struct RampShape {
+    uint32_t v[RAMP_SHAPE_POINTS + 1];
+};
+
+// integer square root of a Q32 fraction, result in Q16
+constexpr uint32_t ramp_sqrt_q16(uint64_t x_q32) {
+    uint64_t lo = 0;
+    uint64_t hi = 65536;
+    uint64_t mid = 0;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (mid * mid <= x_q32) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return((uint32_t)lo);
+}
+
+// trapezoidal: constant acceleration, so v = sqrt(position)
+constexpr RampShape ramp_trap_shape(void) {
+    RampShape s = {};
+    for (int k = 0; k <= RAMP_SHAPE_POINTS; k++) {
+        s.v[k] = (uint32_t)(((uint64_t)k << 16) / RAMP_SHAPE_POINTS);
+    }
+    return(s);
+}
+
+// S-curve: velocity follows v = 3u^2 - 2u^3 over normalized time u, which gives
+// position p = 2u^3 - u^4. The peak acceleration is 1.5 times the trapezoidal one for the same
+// ramp time, so the ramp length is scaled to keep the peak at the requested acceleration.
+constexpr RampShape ramp_scurve_shape(void) {
+    RampShape s = {};
+    for (int k = 0; k <= RAMP_SHAPE_POINTS; k++) {
+        // find u (Q16) where p(u) = (k / RAMP_SHAPE_POINTS)^2, p is monotonic so bisect
+        int64_t target = ((int64_t)k * k << 16) / (RAMP_SHAPE_POINTS * RAMP_SHAPE_POINTS);
+        int64_t lo = 0;
+        int64_t hi = 65536;
+        while (hi - lo > 1) {
+            int64_t u = (lo + hi) / 2;
+            int64_t u2 = (u * u) >> 16;
+            int64_t u3 = (u2 * u) >> 16;
+            int64_t u4 = (u3 * u) >> 16;
+            if (2 * u3 - u4 < target) {
+                lo = u;
+            } else {
+                hi = u;
+            }
+        }
+        int64_t u2 = (hi * hi) >> 16;
+        int64_t u3 = (u2 * hi) >> 16;
+        s.v[k] = (uint32_t)(3 * u2 - 2 * u3);
+    }
+    return(s);
+}
+
+class Ramp {
+    public:
+        Ramp();
+        // Build the interval table for a profile type, a cruise interval in 1/256 microseconds per step,
+        // and an acceleration in steps per second per second
+        void build(int type, uint32_t cruise, uint32_t accel);
+        // Interval before the next step in 1/256 microseconds, when done steps have been issued and left are still to go.
+        // The ramp is mirrored for deceleration, so short moves form a triangle profile.
+        inline uint32_t interval(uint32_t done, uint32_t left) {
+            uint32_t i = (done < left) ? done : left;
+            if (i > 0) {
+                i--;
+            }
+            return((i < mLen) ? mTable[i] : mCruise);
+        }
+        // Number of steps in the ramp (0 if there is no acceleration)
+        uint32_t length(void);
+        // Ramp position (steps from rest) at which a speed of interval (in 1/256 microseconds per step) is
+        // reached, or length() if it is as fast as cruise speed or faster
+        uint32_t reach(uint32_t interval);
+        // Cruise interval in 1/256 microseconds per step
+        uint32_t cruise(void);
+
+    private:
+        uint32_t mTable[RAMP_MAX];
+        uint32_t mLen;
+        uint32_t mCruise;
+};
+
+#endif // __PROFILE_H_FILE__
@@ -0,0 +1,114 @@
+/******************************************************
+ * servobank.cpp
+ * Hobby servos run from one scheduler
+ * ****************************************************/
+
+#include "servobank.h"
+#include "hardware/gpio.h"
+#include "stdio.h"
+
+ServoBank::ServoBank() {
+    int i;
+
+    mCount = 0;
+    mSlices = 0;
+    mAlarm = 0;
+    for (i=0; i<NUM_PWM_SLICES; i++) {
+        mLevels[i][0] = 0;
+        mLevels[i][1] = 0;
+    }
+}
+
+int ServoBank::add(HServo* servo) {
+    if (mCount >= SERVOBANK_MAX) {
+        printf("error, servo bank is full!\n");
+        return(-1);
+    }
+    // the servo's own alarms are no longer used, the bank takes over from the level it is at
+    servo->cancel();
+    servo->mBank = this;
+    mLevels[servo->mPwmslice][servo->mPwmchan] = (uint16_t)servo->step();
+    mSlices |= 1UL << servo->mPwmslice;
+    mServo[mCount] = servo;
+    mCount++;
+    kick(); // to finish a move that was in progress, or switch the power off
+    return(mCount - 1);
+}
+
+HServo* ServoBank::servo(int id) {
+    if ((id < 0) || (id >= mCount)) {
+        return(NULL);
+    }
+    return(mServo[id]);
+}
+
+int ServoBank::count(void) {
+    return(mCount);
+}
+
+bool ServoBank::ready(void) {
+    int i;
+
+    for (i=0; i<mCount; i++) {
+        if (!mServo[i]->ready()) {
+            return(false);
+        }
+    }
+    return(true);
+}
+
+void ServoBank::kick(void) {
+    if (mAlarm > 0) {
+        return; // the running scheduler picks up the move at its next tick
+    }
+    mAlarm = add_alarm_in_ms(HSERVO_SLEW_MS, tick_callback, this, true);
+    if (mAlarm <= 0) {
+        mAlarm = 0;
+        printf("error, no alarm for the servo bank!\n");
+    }
+}
+
+// tick_callback: output the pulse widths of all the servos and switch off the power of those that have
+// settled, once per PWM period while any servo is moving. Called from interrupt context.
+int64_t ServoBank::tick_callback(alarm_id_t id, void* user_data) {
+    ServoBank* bank = (ServoBank*)user_data;
+    HServo* servo;
+    uint32_t pins = 0; // power save pins of the servos in the bank
+    uint32_t moving = 0; // power save pins of the servos that are still moving
+    bool busy = false;
+    uint slice;
+    uint pin;
+    int i;
+
+    for (i=0; i<bank->mCount; i++) {
+        servo = bank->mServo[i];
+        bank->mLevels[servo->mPwmslice][servo->mPwmchan] = (uint16_t)servo->step();
+        if ((servo->mLevel != servo->mTarget) || !servo->ready()) {
+            busy = true;
+            if (servo->mPsaveio) {
+                moving |= 1UL << servo->mPsaveio;
+            }
+        }
+        if (servo->mPsaveio) {
+            pins |= 1UL << servo->mPsaveio;
+        }
+    }
+    // one write per slice sets both its channels
+    for (slice=0; slice<NUM_PWM_SLICES; slice++) {
+        if (bank->mSlices & (1UL << slice)) {
+            pwm_set_both_levels(slice, bank->mLevels[slice][0], bank->mLevels[slice][1]);
+        }
+    }
+    pins &= ~moving;
+    for (pin=0; pins != 0; pin++) {
+        if (pins & (1UL << pin)) {
+            gpio_put(pin, 0); // turn off the servo power
+            pins &= ~(1UL << pin);
+        }
+    }
+    if (!busy) {
+        bank->mAlarm = 0;
+        return(0); // all settled, don't repeat
+    }
+    return(0 - HSERVO_SLEW_MS * 1000); // negative is from the time this tick was due, so the rate does not drift
+}
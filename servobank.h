@@ -0,0 +1,44 @@
+#ifndef __SERVOBANK_H_FILE__
+#define __SERVOBANK_H_FILE__
+
+// servobank.h
+// Up to SERVOBANK_MAX hobby servos (HServo) run from one scheduler. setAng() and the other HServo
+// functions work as before, but instead of each servo writing its own PWM level and running its own
+// alarms, the bank's alarm ticks once per PWM period while any servo is moving. Each tick steps the
+// slewing servos, writes the levels of both channels of each PWM slice in one go, and switches off the
+// power save pins of the servos that have settled (a pin shared by several servos stays on until they
+// all have). Servos moved one after another therefore move in the same PWM period.
+
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/pwm.h"
+#include "hservo.h"
+
+#define SERVOBANK_MAX 8 // most servos in a bank
+
+class ServoBank {
+    public:
+        // ServoBank constructor
+        ServoBank();
+        // Add a servo to the bank, returns its id (0 for the first servo added), or -1 if the bank is
+        // full. Call from the core that moves the servos.
+        int add(HServo* servo);
+        // The servo with the given id, or NULL if there is none
+        HServo* servo(int id);
+        // Number of servos in the bank
+        int count(void);
+        // Returns true once all the servos in the bank are expected to have completed their moves
+        bool ready(void);
+        // Start the scheduler, if it is not already running. Called by HServo when a servo in the bank moves.
+        void kick(void);
+
+    private:
+        static int64_t tick_callback(alarm_id_t id, void* user_data);
+        HServo* mServo[SERVOBANK_MAX];
+        int mCount;
+        uint32_t mSlices; // PWM slices with a servo, one bit per slice
+        uint16_t mLevels[NUM_PWM_SLICES][2]; // pulse widths of both channels of each slice, in usec
+        volatile alarm_id_t mAlarm; // the scheduler alarm, or 0
+};
+
+#endif // __SERVOBANK_H_FILE__
@@ -2,34 +2,34 @@
 #define __SMOT_H_FILE__
 
 #include "pico/stdlib.h"
+#include "smotgroup.h"
 
-class SMot {
+// A single stepper motor on channel CHAN (1-4), the one motor case of SMotGroup (see smotgroup.h for
+// speed, mode, profile, accel, usePlanner, ready, busy and onDone). An invalid channel fails to compile.
+template <uint16_t CHAN>
+class SMot : public SMotGroup<CHAN> {
     public:
-        // SMot constructor
-        // parameters: chan is 1-4 (up to 4 stepper motors are supported)
-        //             steps is number of steps necessary for 360 degrees revolution,
+        // SMot constructor, e.g. SMot<3> motor(1000);
+        // parameters: steps is number of steps necessary for 360 degrees revolution,
         //                 it is dependant on the motor and any gearing attached.
         //             psave determines if the motor current is switched off after motion
         //                 (defaults to 1, i.e. save power)
-        SMot (uint16_t chan, uint16_t numsteps, int psave = 1);
-        // Set speed; larger number is faster.
-        void speed(long speed);
-        // Move motor by n steps (direction is 0 or 1)
-        void step(int n, int direction);
+        //             backend is BACKEND_GPIO or BACKEND_PIO (see stepseq.h), if the PIO cannot be
+        //                 used then the motor falls back to GPIO
+        SMot (uint16_t numsteps, int psave = 1, int backend = BACKEND_GPIO)
+            : SMotGroup<CHAN>(numsteps, psave, backend) {
+        }
+        // Start moving motor by n steps (direction is 0 or 1). Returns immediately, the steps are
+        // issued from a timer alarm. Returns false if a move is already in progress.
+        bool step(int n, int direction) {
+            int steps[1];
 
-    private:
-        void stepMotor(int step);
-        int dir;
-        unsigned long delay;
-        int steps360; // number of steps for 360 degree revolution
-        int stepcount;
-        int pin1;
-        int pin2;
-        int pin3;
-        int pin4;
-        int powersave;
-
-        unsigned long last_step_us_time;
+            if (n <= 0) {
+                return(!this->busy());
+            }
+            steps[0] = (direction == 1) ? n : 0 - n;
+            return(this->move(steps));
+        }
 };
 
 #endif // __SMOT_H_FILE__
@@ -0,0 +1,1234 @@
+#ifndef __SMOTGROUP_H_FILE__
+#define __SMOTGROUP_H_FILE__
+
+// smotgroup.h
+// A group of stepper motors that move together, on the channels given as template parameters, e.g.
+// SMotGroup<1, 2>. All the motors in a move start and finish at the same moment: the motor with the
+// most steps steps on every tick, and the others are spread evenly over the move with integer
+// (Bresenham) accumulators. The channels are fixed at compile time, so the loops over the motors have
+// a constant trip count and the compiler unrolls them with the pin masks as constants.
+// SMot (smot.h) and SMotPair (smotpair.h) are the one and two motor groups.
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "stdio.h"
+#include <cstdlib>
+#include "stepseq.h"
+#include "profile.h"
+#include "planner.h"
+#include "smotpins.h"
+
+// places a function in SRAM
+#define SMOT_RAM __not_in_flash("smot")
+
+#define JOG_TICK_US 50 // velocity (jog) mode updates the motors at this interval
+#define JOG_DEADMAN_MS 250 // default time a jog setpoint lasts before the motors are stopped
+#define SMOT_HIST 16 // PIO words remembered for abort(), a power of 2 larger than STEPSEQ_FIFO_DEPTH
+
+// halt requests, applied by the step alarm at its next tick
+#define HALT_NONE 0
+#define HALT_STOP 1
+#define HALT_PAUSE 2
+
+template <uint16_t... CHANS>
+class SMotGroup {
+    static constexpr int N = sizeof...(CHANS); // number of motors
+    static_assert((N >= 1) && (N <= SMOT_NUM_CHANS), "a group has 1 to SMOT_NUM_CHANS motors");
+    static_assert(N <= PLAN_AXES, "the planner cannot queue moves with this many motors");
+    static_assert(chans_distinct(SMotChan<CHANS>::mask...), "a channel is used twice in the group");
+    static_assert((0xffffffffULL >> RAMP_FRAC_BITS) <= STEPSTREAM_MAX_TICKS, "refill() expects each step to fit in one PIO word");
+
+    public:
+        // SMotGroup constructor
+        // parameters: steps is number of steps necessary for 360 degrees revolution,
+        //                 it is dependant on the motor and any gearing attached.
+        //             psave determines if the motor current is switched off after motion
+        //                 (defaults to 1, i.e. save power)
+        //             backend is BACKEND_GPIO or BACKEND_PIO (see stepseq.h), if the PIO cannot be
+        //                 used then the group falls back to GPIO
+        SMotGroup(uint16_t numsteps, int psave = 1, int backend = BACKEND_GPIO);
+        // Attach the alarm pool used to time the steps (the default pool is used if this is not called).
+        // The step alarms run on the core that created the pool, and move() and the settings must be called
+        // from that core. position(), energized(), ready() and busy() can be called from either core.
+        void begin(alarm_pool_t* pool);
+        // Set speed of the motor with the most steps in each move, in rpm; larger number is faster.
+        // The speed, mode, profile and acceleration can only be set while the motors are stopped, they
+        // return false (and the setting is unchanged) if a move is running or paused.
+        bool speed(long speed);
+        // Set speed in thousandths of an rpm, for speeds between whole rpm values
+        bool speedMilli(long mrpm);
+        // Speed set by speed() or speedMilli(), in thousandths of an rpm
+        long rpmMilli(void);
+        // Set the speed of the moves queued from now on, in thousandths of an rpm (0 for the speed set by
+        // speed()). It can only be slower than that speed, as the acceleration ramp is built for it. Unlike
+        // speed() it can be set while the motors run, queued moves at different feeds run back to back.
+        void feed(long mrpm);
+        // Set the drive mode (DRIVE_FULL, DRIVE_HALF or DRIVE_WAVE, see smotpins.h).
+        // In half step mode, step counts are in half steps.
+        bool mode(int drive);
+        // Set the acceleration profile type (PROFILE_NONE, PROFILE_TRAP or PROFILE_SCURVE, see profile.h)
+        bool profile(int type);
+        // Set the maximum acceleration, in rpm per second (0 starts and stops at full speed)
+        bool accel(long accel);
+        // Start moving each motor by its number of steps in the steps array, positive is direction 1.
+        // Motors with 0 steps hold their position. Returns immediately, the steps are issued from a
+        // timer alarm. Returns false if a move is already in progress.
+        bool move(const int* steps);
+        // Queue moves in a look-ahead planner (see planner.h). move() then adds to the queue, and only
+        // returns false if it is full. Queued moves run back to back with the coils kept energized,
+        // and slow down at the junctions between them only as much as the change of direction needs.
+        void usePlanner(Planner* planner);
+        // Absolute position of motor idx, in steps of the current drive mode (positive is direction 1).
+        // It is updated as each step is issued, and is zero at power up.
+        int64_t position(int idx);
+        // Position that motor idx will be at once all the moves started or queued so far have completed
+        int64_t target(int idx);
+        // With power saving, keep the coils energized for ms milliseconds after a move, so that a move
+        // arriving within that time starts without re-energizing them. 0 switches them off straight away.
+        void idleTimeout(uint32_t ms);
+        // Total time the coils have been energized, in milliseconds
+        uint64_t energized(void);
+        // Velocity (jog) mode: run each motor continuously at its speed in the rpm array, positive is direction 1.
+        // Each call sets new speeds, which the motors ramp to at the acceleration set by accel(), and the
+        // speeds are limited to the one set by speed(). If no new speeds arrive within the deadman time the
+        // motors ramp down to a stop, as they do when all the speeds are 0. Jogging can only start once
+        // any queued moves have completed, returns false otherwise. No moves are accepted while jogging.
+        bool jog(const long* rpm);
+        // Set the deadman time for jog(), in milliseconds
+        void deadman(uint32_t ms);
+        // Controlled stop: decelerate to rest from the speed reached, within the current move, and drop the
+        // queued moves. Jogging motors ramp down to a stop. Takes effect at the next step.
+        bool stop(void);
+        // Immediate stop: no more steps are issued and the queued moves are dropped. The coils stay energized
+        // so the position (which is kept accurate) is held.
+        bool abort(void);
+        // Decelerate to rest as stop() does, but keep the rest of the moves for resume(). busy() stays true.
+        bool pause(void);
+        // Continue after pause(), accelerating from rest. Returns false if still decelerating for the pause.
+        bool resume(void);
+        // Returns true once paused at rest
+        bool paused(void);
+        // Steps motor idx still has to go: while paused, what resume() will issue, otherwise what the last
+        // stop() or abort() dropped
+        int64_t remaining(int idx);
+        // Time (as to_us_since_boot) at which the last halt request was acted on by the step alarm
+        uint64_t halted(void);
+        // Returns true if another move can be started (or queued, if there is a planner)
+        bool ready(void);
+        // Returns true while a move is in progress
+        bool busy(void);
+        // Set a function to be called when a move completes. It is called from interrupt context.
+        void onDone(void (*callback)(void* ctx), void* ctx);
+
+    private:
+        // the step path runs from SRAM (see SMOT_RAM), so flash accesses by the other core do not delay it
+        static int64_t alarm_callback(alarm_id_t id, void* user_data) SMOT_RAM;
+        static int64_t off_callback(alarm_id_t id, void* user_data);
+        void powerUp(void);
+        void powerDown(void);
+        bool queue(const int* steps);
+        bool setup(const int* steps);
+        bool start(void);
+        bool loadNext(void) SMOT_RAM;
+        uint32_t nextInterval(void) SMOT_RAM;
+        int64_t tick(void) SMOT_RAM;
+        int64_t jogTick(void) SMOT_RAM;
+        bool request(int req);
+        void halt(void) SMOT_RAM;
+        int64_t rest(void) SMOT_RAM;
+        void kick(void);
+        void putWord(int idx, int pattern, uint32_t us) SMOT_RAM;
+        void rewind(int idx, int level);
+        int64_t jogRate(long rpm);
+        int64_t refill(void) SMOT_RAM;
+        void nextStep(int idx) SMOT_RAM;
+        void nextSteps(void) SMOT_RAM;
+        void finish(void);
+        bool buildRamp(void);
+        void stepMotors(void) SMOT_RAM;
+        uint32_t toUs(uint32_t interval) SMOT_RAM;
+        uint32_t rpmInterval(long mrpm);
+        void feedCap(uint32_t* interval, uint32_t* cap);
+        uint32_t rampPos(uint32_t done) SMOT_RAM;
+        int dir[N];
+        uint32_t delay; // cruise interval between steps, in 1/256 microseconds (see RAMP_FRAC_BITS)
+        uint32_t frac; // fraction of a microsecond carried over from the previous interval
+        long mrpm; // speed, in thousandths of an rpm
+        long feed_mrpm; // speed of the moves queued next, or 0 for mrpm
+        uint32_t feed_iv; // cruise interval of the current move if slower than delay, otherwise 0
+        uint32_t cap_k; // ramp position of the speed of the current move
+        int steps360; // number of steps for 360 degree revolution
+        volatile int64_t abs_pos[N]; // absolute position, in half steps
+        int64_t end_pos[N]; // absolute position after the moves accepted so far, in half steps
+        int phase[N]; // half-step coil state, 0-7
+        int drive; // drive mode
+        static constexpr uint16_t chan[N] = {CHANS...};
+        static constexpr uint32_t coil_mask = (SMotChan<CHANS>::mask | ...); // coil pins of all the motors
+        int powersave;
+        uint32_t idle_ms; // time the coils stay energized after a move
+        alarm_id_t off_alarm; // pending power down, or 0
+        volatile bool coils_on;
+        volatile uint64_t on_since; // time the coils were energized
+        volatile uint64_t on_us; // total energized time, not counting the current period
+
+        uint64_t last_step_us_time;
+        volatile int steps_left;
+        volatile bool running;
+        int count[N]; // steps of each motor in the current move
+        uint32_t acc[N]; // Bresenham accumulators
+        int steps_total; // number of ticks in the current move (the largest step count)
+        alarm_pool_t* pool;
+        void (*done_callback)(void* ctx);
+        void* done_ctx;
+        int backend;
+        StepSeq seq[N];
+        bool tail_queued; // PIO backend: all words of the move are in the FIFOs
+        int ramp_type;
+        long max_accel; // rpm per second
+        Ramp ramp; // step intervals, rebuilt when the speed or acceleration changes
+        Planner* planner;
+        plan_seg_t* seg; // planner segment being executed, or NULL
+        uint32_t entry_k; // entry and exit speeds of the current move, as ramp positions
+        uint32_t exit_k;
+        bool exit_fixed; // the exit speed can no longer be raised by the planner
+        volatile bool jog_on; // in velocity mode
+        int64_t jog_vel[N]; // speed of each motor, in steps per jog tick (Q32), the sign is the direction
+        volatile int64_t jog_tgt[N]; // speed each motor is ramping to
+        uint32_t jog_acc[N]; // phase accumulators, a step is issued each time one wraps
+        int64_t jog_dv; // largest change of speed in one jog tick
+        uint32_t deadman_ticks;
+        volatile uint32_t jog_left; // jog ticks left before the deadman stops the motors
+        alarm_id_t step_alarm; // the alarm issuing the steps, or 0
+        volatile int halt_req; // HALT_* waiting for the next tick
+        volatile uint64_t halt_at; // time the last halt request was acted on
+        bool pausing; // decelerating for a pause
+        volatile bool is_paused; // at rest part way through the moves
+        int hold_left; // steps of the current move left for resume()
+        int resume_at; // steps of the current move issued before resuming, the ramp starts again from there
+        int64_t dropped[N]; // steps dropped by the last stop or abort, in half steps
+        uint32_t seq_words[N]; // words put into each state machine
+        int64_t hist_pos[N][SMOT_HIST]; // position after each of the last words put
+        uint8_t hist_phase[N][SMOT_HIST]; // phase after each of the last words put
+};
+
+template <uint16_t... CHANS>
+SMotGroup<CHANS...>::SMotGroup(uint16_t numsteps, int psave, int backend) {
+    int i;
+    bool pio_ok = true;
+
+    this->steps360 = numsteps;
+    for (i=0; i<N; i++) {
+        this->abs_pos[i] = 0;
+        this->end_pos[i] = 0;
+        this->phase[i] = 0;
+        this->dir[i] = 0;
+        this->count[i] = 0;
+        this->acc[i] = 0;
+    }
+    this->drive = DRIVE_FULL;
+    this->last_step_us_time = 0;
+    this->frac = 0;
+    this->mrpm = 50 * 1000; // default speed is 50
+    this->delay = (uint32_t)((60000000000ULL << RAMP_FRAC_BITS) / this->steps360 / this->mrpm);
+    this->feed_mrpm = 0;
+    this->feed_iv = 0;
+    this->cap_k = RAMP_MAX;
+    this->powersave = psave;
+    this->idle_ms = 0;
+    this->off_alarm = 0;
+    this->coils_on = false;
+    this->on_since = 0;
+    this->on_us = 0;
+    this->steps_left = 0;
+    this->running = false;
+    this->steps_total = 0;
+    this->pool = NULL;
+    this->done_callback = NULL;
+    this->done_ctx = NULL;
+    gpio_init_mask(this->coil_mask);
+    gpio_set_dir_out_masked(this->coil_mask);
+    this->backend = BACKEND_GPIO;
+    this->tail_queued = false;
+    this->ramp_type = PROFILE_NONE;
+    this->max_accel = 0;
+    this->planner = NULL;
+    this->seg = NULL;
+    this->entry_k = 0;
+    this->exit_k = 0;
+    this->exit_fixed = true;
+    this->jog_on = false;
+    this->jog_dv = 0;
+    this->jog_left = 0;
+    deadman(JOG_DEADMAN_MS);
+    this->step_alarm = 0;
+    this->halt_req = HALT_NONE;
+    this->halt_at = 0;
+    this->pausing = false;
+    this->is_paused = false;
+    this->hold_left = 0;
+    this->resume_at = 0;
+    for (i=0; i<N; i++) {
+        this->jog_vel[i] = 0;
+        this->jog_tgt[i] = 0;
+        this->jog_acc[i] = 0;
+        this->dropped[i] = 0;
+        this->seq_words[i] = 0;
+        this->hist_pos[i][0] = 0;
+        this->hist_phase[i][0] = 0;
+    }
+    buildRamp();
+    if (backend == BACKEND_PIO) {
+        for (i=0; i<N; i++) {
+            if (!this->seq[i].init(chan_pins[this->chan[i]][0], chan_pins[this->chan[i]][1],
+                                   chan_pins[this->chan[i]][2], chan_pins[this->chan[i]][3])) {
+                pio_ok = false;
+                break;
+            }
+        }
+        if (pio_ok) {
+            this->backend = BACKEND_PIO;
+        } else {
+            printf("falling back to GPIO stepping\n");
+        }
+    }
+}
+
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::begin(alarm_pool_t* pool) {
+    this->pool = pool;
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::speed(long speed) {
+    return(speedMilli(speed * 1000));
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::speedMilli(long mrpm) {
+    if (mrpm <= 0) {
+        printf("error, invalid speed!\n");
+        return(false);
+    }
+    if (this->running) {
+        return(false);
+    }
+    this->mrpm = mrpm;
+    this->delay = rpmInterval(mrpm);
+    return(buildRamp());
+}
+
+template <uint16_t... CHANS>
+long SMotGroup<CHANS...>::rpmMilli(void) {
+    return(this->mrpm);
+}
+
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::feed(long mrpm) {
+    this->feed_mrpm = (mrpm > 0) ? mrpm : 0;
+}
+
+// rpmInterval: step interval for a speed in thousandths of an rpm, in 1/256 microseconds
+template <uint16_t... CHANS>
+uint32_t SMotGroup<CHANS...>::rpmInterval(long mrpm) {
+    uint64_t d;
+
+    d = (60000000000ULL << RAMP_FRAC_BITS) / this->steps360 / mrpm;
+    if (this->drive == DRIVE_HALF) {
+        d = d / 2; // twice as many steps per revolution
+    }
+    if (d < (1UL << RAMP_FRAC_BITS)) {
+        d = 1UL << RAMP_FRAC_BITS; // no faster than one step per microsecond
+    }
+    return((d > 0xffffffffULL) ? 0xffffffffUL : (uint32_t)d);
+}
+
+// feedCap: cruise interval and ramp position of the feed for the next move. A feed at or above the
+// motor's speed runs at that speed.
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::feedCap(uint32_t* interval, uint32_t* cap) {
+    *interval = 0;
+    *cap = this->ramp.length();
+    if (this->feed_mrpm > 0) {
+        *interval = rpmInterval(this->feed_mrpm);
+        if (*interval <= this->delay) {
+            *interval = 0;
+        } else {
+            *cap = this->ramp.reach(*interval);
+        }
+    }
+}
+
+// rampPos: ramp position (speed) reached after done steps of the current move
+template <uint16_t... CHANS>
+uint32_t SMotGroup<CHANS...>::rampPos(uint32_t done) {
+    uint32_t k = done + this->entry_k;
+
+    return((k < this->cap_k) ? k : this->cap_k);
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::mode(int drive) {
+    if (this->running) {
+        return(false);
+    }
+    this->drive = drive;
+    return(speedMilli(this->mrpm));
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::profile(int type) {
+    if (this->running) {
+        return(false);
+    }
+    this->ramp_type = type;
+    return(buildRamp());
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::accel(long accel) {
+    if (this->running) {
+        return(false);
+    }
+    this->max_accel = accel;
+    return(buildRamp());
+}
+
+// buildRamp: recompute the step interval table. The step alarm reads the table, so it is not rebuilt
+// while a move is running (or paused), and false is returned instead of waiting for the move, which
+// could be paused for good. The intervals are those of the motor taking the most steps.
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::buildRamp(void) {
+    if (this->running) {
+        return(false);
+    }
+    this->ramp.build(this->ramp_type, this->delay, this->max_accel * this->steps360 / 60);
+    return(true);
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::move(const int* steps) {
+    int i;
+    bool ok;
+
+    if (this->jog_on) {
+        ok = false; // no moves while jogging
+    } else if (this->planner != NULL) {
+        ok = queue(steps);
+    } else if (this->running) {
+        ok = false;
+    } else if (!setup(steps)) {
+        ok = true;
+    } else {
+        this->seg = NULL;
+        this->entry_k = 0;
+        this->exit_k = 0;
+        this->exit_fixed = true;
+        feedCap(&this->feed_iv, &this->cap_k);
+        ok = start();
+    }
+    if (ok) {
+        for (i=0; i<N; i++) {
+            this->end_pos[i] += (int64_t)steps[i] * drive_stride(this->drive);
+        }
+    }
+    return(ok);
+}
+
+// queue: add a move to the planner, and start the motors if they are stopped
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::queue(const int* steps) {
+    uint32_t interval;
+    uint32_t cap;
+    int i;
+    bool any = false;
+
+    for (i=0; i<N; i++) {
+        if (steps[i] != 0) {
+            any = true;
+        }
+    }
+    if (!any) {
+        return(true);
+    }
+    feedCap(&interval, &cap);
+    if (!this->planner->add(steps, N, interval, cap)) {
+        return(false);
+    }
+    if (this->running) {
+        return(true); // the move starts when the ones ahead of it complete
+    }
+    this->exit_k = 0; // starting from rest
+    if (!loadNext()) {
+        return(true);
+    }
+    return(start());
+}
+
+// setup: set the directions and step counts for a move, returns false if there are no steps
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::setup(const int* steps) {
+    int i;
+
+    this->steps_total = 0;
+    for (i=0; i<N; i++) {
+        this->dir[i] = (steps[i] >= 0) ? 1 : 0;
+        this->count[i] = abs(steps[i]);
+        if (this->count[i] > this->steps_total) {
+            this->steps_total = this->count[i];
+        }
+    }
+    this->steps_left = this->steps_total;
+    this->resume_at = 0;
+    for (i=0; i<N; i++) {
+        this->phase[i] = drive_phase(this->drive, this->phase[i]);
+        this->acc[i] = this->steps_total / 2; // centres the steps of the slower motors
+    }
+    return(this->steps_total > 0);
+}
+
+// start: issue the steps of the move that has been set up from the alarm
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::start(void) {
+    uint64_t now;
+    uint64_t wait = 0;
+
+    this->tail_queued = false;
+    this->running = true;
+    powerUp();
+    // the first step is issued as soon as the delay since the previous step has elapsed
+    this->frac = 0;
+    now = to_us_since_boot(get_absolute_time());
+    if (now - this->last_step_us_time < (this->delay >> RAMP_FRAC_BITS)) {
+        wait = (this->delay >> RAMP_FRAC_BITS) - (now - this->last_step_us_time);
+    }
+    this->step_alarm = alarm_pool_add_alarm_in_us(this->pool, wait, alarm_callback, this, true);
+    if (this->step_alarm < 0) {
+        printf("error, no free alarm!\n");
+        this->step_alarm = 0;
+        this->steps_left = 0;
+        this->running = false;
+        return(false);
+    }
+    return(true);
+}
+
+// loadNext: set up the next segment from the planner, runs in interrupt context while moving.
+// returns false if there are no more segments
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::loadNext(void) {
+    uint32_t reached;
+
+    if (this->planner == NULL) {
+        return(false);
+    }
+    // the speed reached at the end of the previous segment limits the entry speed of this one
+    reached = rampPos(this->steps_total - this->resume_at);
+    if (this->exit_k < reached) {
+        reached = this->exit_k;
+    }
+    this->seg = this->planner->next();
+    if (this->seg == NULL) {
+        return(false);
+    }
+    setup(this->seg->steps);
+    this->entry_k = (this->seg->entry < reached) ? this->seg->entry : reached;
+    this->exit_k = this->seg->exit;
+    this->exit_fixed = false;
+    this->feed_iv = this->seg->feed;
+    this->cap_k = this->seg->cap;
+    return(true);
+}
+
+// nextInterval: time to the next step, from the ramp offset by the entry and exit speeds of the segment.
+// The exit speed follows the planner until deceleration starts, after that it is fixed. A move with a
+// slower feed climbs the ramp only as far as its speed, and cruises at its own interval.
+template <uint16_t... CHANS>
+uint32_t SMotGroup<CHANS...>::nextInterval(void) {
+    uint32_t k = rampPos(this->steps_total - this->steps_left - this->resume_at);
+    uint32_t interval;
+
+    if (!this->exit_fixed) {
+        this->exit_k = this->seg->exit;
+        if (this->steps_left + this->exit_k <= k) {
+            this->exit_fixed = true;
+        }
+    }
+    interval = this->ramp.interval(k, this->steps_left + this->exit_k);
+    return((interval < this->feed_iv) ? this->feed_iv : interval);
+}
+
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::usePlanner(Planner* planner) {
+    this->planner = planner;
+}
+
+// position and target are kept in half steps, and converted to steps of the drive mode when they are read
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::position(int idx) {
+    int64_t pos;
+
+    // the 64-bit value is updated by the step alarm, which may be running on the other core,
+    // so it is read until two reads agree
+    do {
+        pos = this->abs_pos[idx];
+    } while (pos != this->abs_pos[idx]);
+    return(pos / drive_stride(this->drive));
+}
+
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::target(int idx) {
+    return(this->end_pos[idx] / drive_stride(this->drive));
+}
+
+// jogRate: jog speed in steps per jog tick (Q32) for a speed in rpm, limited to the speed set by speed()
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::jogRate(long rpm) {
+    uint64_t per_rpm;
+    uint64_t rate;
+    uint64_t cruise;
+
+    per_rpm = ((uint64_t)this->steps360 * JOG_TICK_US << 32) / 60000000ULL;
+    if (this->drive == DRIVE_HALF) {
+        per_rpm = per_rpm * 2; // twice as many steps per revolution
+    }
+    rate = per_rpm * (uint64_t)abs(rpm);
+    cruise = per_rpm * this->mrpm / 1000;
+    if (rate > cruise) {
+        rate = cruise;
+    }
+    if (rate > 0xffffffffULL) {
+        rate = 0xffffffffULL; // at most one step per tick
+    }
+    return((rpm < 0) ? 0 - (int64_t)rate : (int64_t)rate);
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::jog(const long* rpm) {
+    int64_t tgt[N];
+    uint32_t irq;
+    bool any = false;
+    int i;
+
+    for (i=0; i<N; i++) {
+        tgt[i] = jogRate(rpm[i]);
+        if (tgt[i] != 0) {
+            any = true;
+        }
+    }
+    // the jog tick can finish the jog at any time, so check and update together
+    irq = save_and_disable_interrupts();
+    if (this->jog_on) {
+        for (i=0; i<N; i++) {
+            this->jog_tgt[i] = tgt[i];
+        }
+        this->jog_left = this->deadman_ticks;
+        restore_interrupts(irq);
+        return(true);
+    }
+    restore_interrupts(irq);
+    if (this->running || ((this->planner != NULL) && !this->planner->empty())) {
+        return(false);
+    }
+    if (!any) {
+        return(true); // already stopped
+    }
+
+    // start from rest
+    for (i=0; i<N; i++) {
+        this->jog_vel[i] = 0;
+        this->jog_tgt[i] = tgt[i];
+        this->jog_acc[i] = 0;
+        this->phase[i] = drive_phase(this->drive, this->phase[i]);
+    }
+    if ((this->ramp_type == PROFILE_NONE) || (this->max_accel == 0)) {
+        this->jog_dv = 1LL << 33; // straight to the new speed
+    } else {
+        this->jog_dv = jogRate(1) * this->max_accel * JOG_TICK_US / 1000000;
+        if (this->jog_dv < 1) {
+            this->jog_dv = 1;
+        }
+    }
+    this->jog_left = this->deadman_ticks;
+    this->jog_on = true;
+    this->running = true;
+    powerUp();
+    this->step_alarm = alarm_pool_add_alarm_in_us(this->pool, JOG_TICK_US, alarm_callback, this, true);
+    if (this->step_alarm < 0) {
+        printf("error, no free alarm!\n");
+        this->step_alarm = 0;
+        this->jog_on = false;
+        this->running = false;
+        return(false);
+    }
+    return(true);
+}
+
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::deadman(uint32_t ms) {
+    this->deadman_ticks = ms * 1000 / JOG_TICK_US;
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::ready(void) {
+    if (this->jog_on) {
+        return(false);
+    }
+    if (this->planner != NULL) {
+        return(this->planner->ready());
+    }
+    return(!this->running);
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::busy(void) {
+    return(this->running);
+}
+
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::onDone(void (*callback)(void* ctx), void* ctx) {
+    this->done_callback = callback;
+    this->done_ctx = ctx;
+}
+
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::alarm_callback(alarm_id_t id, void* user_data) {
+    SMotGroup<CHANS...>* group = (SMotGroup<CHANS...>*)user_data;
+
+    if (group->jog_on) {
+        return(group->jogTick());
+    }
+    return(group->tick());
+}
+
+// nextStep: advance the position and the coil phase of one motor by one step in its current direction.
+// The position is kept in half steps, so it does not depend on the drive mode.
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::nextStep(int idx) {
+    int stride = drive_stride(this->drive);
+
+    if (this->dir[idx] == 1) {
+        this->abs_pos[idx] += stride;
+        this->phase[idx] = (this->phase[idx] + stride) & (SMOT_NUM_PHASES - 1);
+    } else {
+        this->abs_pos[idx] -= stride;
+        this->phase[idx] = (this->phase[idx] - stride) & (SMOT_NUM_PHASES - 1);
+    }
+}
+
+// nextSteps: advance each motor that is due a step on this tick of the move
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::nextSteps(void) {
+    int i;
+
+    if constexpr (N == 1) {
+        nextStep(0); // a single motor steps on every tick
+    } else {
+        for (i=0; i<N; i++) {
+            this->acc[i] += this->count[i];
+            if (this->acc[i] >= (uint32_t)this->steps_total) {
+                this->acc[i] -= this->steps_total;
+                nextStep(i);
+            }
+        }
+    }
+}
+
+// finish: called in interrupt context once the last step has been issued
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::finish(void) {
+    int i;
+
+    // a halt can cut the moves short, the target becomes where the motors stopped
+    for (i=0; i<N; i++) {
+        this->dropped[i] = this->end_pos[i] - this->abs_pos[i];
+        this->end_pos[i] = this->abs_pos[i];
+    }
+    this->step_alarm = 0;
+    if (this->powersave) { // shut down motors if we are power-saving, now or once they have been idle for a while
+        this->off_alarm = 0;
+        if (this->idle_ms > 0) {
+            this->off_alarm = alarm_pool_add_alarm_in_ms(this->pool, this->idle_ms, off_callback, this, true);
+        }
+        if (this->off_alarm <= 0) {
+            this->off_alarm = 0;
+            powerDown();
+        }
+    }
+    this->running = false;
+    if (this->done_callback != NULL) {
+        this->done_callback(this->done_ctx);
+    }
+}
+
+// tick: issues one step of the move, runs in interrupt context.
+// returns the time to the next step, or 0 when the move is complete
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::tick(void) {
+    if (this->backend == BACKEND_PIO) {
+        return(refill());
+    }
+    if (this->halt_req != HALT_NONE) {
+        halt();
+    }
+    if (this->steps_left > 0) {
+        this->last_step_us_time = to_us_since_boot(get_absolute_time());
+        nextSteps();
+        stepMotors();
+        this->steps_left--;
+    }
+    if ((this->steps_left > 0) || (!this->pausing && loadNext())) {
+        // a negative value reschedules relative to when this alarm was due, so the step timing does not drift
+        return(0 - (int64_t)toUs(nextInterval()));
+    }
+
+    // all steps are complete, or paused
+    return(rest());
+}
+
+// halt: act on a stop or pause request, runs in interrupt context. The current move is cut short so that
+// it decelerates from the speed reached, which takes as many steps as the ramp position of that speed.
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::halt(void) {
+    uint32_t k = rampPos(this->steps_total - this->steps_left - this->resume_at); // speed reached
+    int req = this->halt_req;
+
+    this->halt_req = HALT_NONE;
+    this->halt_at = to_us_since_boot(get_absolute_time());
+    if (this->steps_left + this->exit_k < k) {
+        k = this->steps_left + this->exit_k; // already slowing down
+    }
+    if (k > this->ramp.length()) {
+        k = this->ramp.length(); // at cruise speed, or no ramp at all
+    }
+    if (req == HALT_STOP) {
+        if (this->planner != NULL) {
+            this->planner->clear();
+        }
+        this->pausing = false;
+        this->hold_left = 0;
+        if ((int)k < this->steps_left) {
+            this->steps_left = k;
+        }
+    } else {
+        this->pausing = true;
+        if ((int)k < this->steps_left) {
+            this->hold_left += this->steps_left - k;
+            this->steps_left = k;
+        }
+    }
+    this->exit_k = 0;
+    this->exit_fixed = true;
+}
+
+// rest: the motors have stopped, either paused part way through the moves or with all of them complete.
+// Runs in interrupt context, returns 0 to end the alarm.
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::rest(void) {
+    if (this->pausing) {
+        this->pausing = false;
+        this->step_alarm = 0;
+        this->is_paused = true; // the coils stay energized and running stays set, so no new move starts
+        return(0);
+    }
+    finish();
+    return(0);
+}
+
+// jogTick: one tick of velocity mode, runs in interrupt context every JOG_TICK_US. The speed of each motor
+// moves towards its target by at most jog_dv, and is added to its phase accumulator, which issues a step
+// each time it wraps. Only adds and compares, there is no division here.
+// returns the time to the next tick, or 0 once all the motors have stopped
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::jogTick(void) {
+    uint32_t prev;
+    int64_t tgt;
+    bool stepped = false;
+    bool moving = false;
+    int i;
+
+    if (this->jog_left > 0) {
+        this->jog_left--;
+    } else {
+        for (i=0; i<N; i++) {
+            this->jog_tgt[i] = 0; // no new speeds within the deadman time, stop
+        }
+    }
+    for (i=0; i<N; i++) {
+        tgt = this->jog_tgt[i];
+        if (this->jog_vel[i] < tgt) {
+            this->jog_vel[i] = (tgt - this->jog_vel[i] > this->jog_dv) ? this->jog_vel[i] + this->jog_dv : tgt;
+        } else if (this->jog_vel[i] > tgt) {
+            this->jog_vel[i] = (this->jog_vel[i] - tgt > this->jog_dv) ? this->jog_vel[i] - this->jog_dv : tgt;
+        }
+        if ((this->jog_vel[i] != 0) || (tgt != 0)) {
+            moving = true;
+        }
+        if (this->jog_vel[i] == 0) {
+            continue;
+        }
+        this->dir[i] = (this->jog_vel[i] > 0) ? 1 : 0;
+        prev = this->jog_acc[i];
+        this->jog_acc[i] += (uint32_t)((this->jog_vel[i] > 0) ? this->jog_vel[i] : 0 - this->jog_vel[i]);
+        if (this->jog_acc[i] < prev) {
+            nextStep(i);
+            if (this->backend == BACKEND_PIO) {
+                putWord(i, halfstep_pattern[this->phase[i]], STEPSTREAM_MIN_TICKS);
+            }
+            stepped = true;
+        }
+    }
+    if (stepped && (this->backend != BACKEND_PIO)) {
+        stepMotors();
+    }
+    if (moving) {
+        return(0 - (int64_t)JOG_TICK_US);
+    }
+
+    // all the motors have stopped
+    for (i=0; i<N; i++) {
+        this->end_pos[i] = this->abs_pos[i]; // nothing was dropped
+    }
+    this->jog_on = false;
+    this->last_step_us_time = to_us_since_boot(get_absolute_time());
+    finish();
+    return(0);
+}
+
+// refill: tops up the PIO FIFOs with step words, runs in interrupt context.
+// The state machines are fed in lockstep, one word per tick each.
+// returns the time to the next refill, or 0 when the move is complete
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::refill(void) {
+    int i;
+    int space;
+    uint32_t interval;
+
+    if (this->halt_req != HALT_NONE) {
+        halt();
+    }
+    if (this->tail_queued) {
+        // everything has been queued, wait for the state machines to play it out
+        for (i=0; i<N; i++) {
+            if (!this->seq[i].idle()) {
+                return(this->delay >> RAMP_FRAC_BITS);
+            }
+        }
+        this->last_step_us_time = to_us_since_boot(get_absolute_time());
+        return(rest());
+    }
+    space = this->seq[0].space();
+    for (i=1; i<N; i++) {
+        if (this->seq[i].space() < space) {
+            space = this->seq[i].space();
+        }
+    }
+    while (space > 0) {
+        if ((this->steps_left > 0) || (!this->pausing && loadNext())) {
+            this->steps_left--;
+            interval = toUs(nextInterval());
+            nextSteps();
+            for (i=0; i<N; i++) {
+                putWord(i, halfstep_pattern[this->phase[i]], interval);
+            }
+        } else {
+            this->tail_queued = true;
+            break;
+        }
+        space--;
+    }
+    space = STEPSEQ_FIFO_DEPTH - this->seq[0].space();
+    if (this->tail_queued) {
+        return((int64_t)(this->delay >> RAMP_FRAC_BITS) * space + 1);
+    }
+    // come back when the FIFOs are half empty
+    return((int64_t)(this->delay >> RAMP_FRAC_BITS) * (space / 2 + 1));
+}
+
+// putWord: queue a coil pattern on the state machine of motor idx, and note the position and phase the
+// word leaves the motor at, so that abort() can go back to the word being played
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::putWord(int idx, int pattern, uint32_t us) {
+    uint32_t slot;
+    int n;
+
+    if (!this->seq[idx].put(pattern, us)) {
+        return;
+    }
+    // a long hold is split over several words, each leaves the motor at the same place
+    for (n = StepStream::words(us); n > 0; n--) {
+        this->seq_words[idx]++;
+        slot = this->seq_words[idx] & (SMOT_HIST - 1);
+        this->hist_pos[idx][slot] = this->abs_pos[idx];
+        this->hist_phase[idx][slot] = (uint8_t)this->phase[idx];
+    }
+}
+
+// rewind: level words were discarded from the FIFO of motor idx, go back to the position and phase
+// of the word it is playing
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::rewind(int idx, int level) {
+    uint32_t slot;
+
+    if (level <= 0) {
+        return;
+    }
+    this->seq_words[idx] -= level;
+    slot = this->seq_words[idx] & (SMOT_HIST - 1);
+    this->abs_pos[idx] = this->hist_pos[idx][slot];
+    this->phase[idx] = this->hist_phase[idx][slot];
+}
+
+// request: ask the step alarm to stop or pause, called from the core that runs the alarm
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::request(int req) {
+    uint32_t irq;
+    int i;
+
+    irq = save_and_disable_interrupts();
+    if (this->jog_on) {
+        for (i=0; i<N; i++) {
+            this->jog_tgt[i] = 0; // ramp down, jogging does not resume
+        }
+        this->jog_left = 0;
+        this->halt_at = to_us_since_boot(get_absolute_time());
+    } else if (this->is_paused) {
+        if (req == HALT_STOP) {
+            // drop the rest of the moves, the motors are already at rest
+            this->is_paused = false;
+            this->hold_left = 0;
+            if (this->planner != NULL) {
+                this->planner->clear();
+                this->planner->next();
+            }
+            finish();
+        }
+        this->halt_at = to_us_since_boot(get_absolute_time());
+    } else if (this->running) {
+        this->halt_req = req;
+        kick();
+    } else {
+        for (i=0; i<N; i++) {
+            this->dropped[i] = 0; // already at rest, nothing to drop
+        }
+        this->halt_at = to_us_since_boot(get_absolute_time());
+    }
+    restore_interrupts(irq);
+    return(true);
+}
+
+// kick: run the refill straight away rather than when the FIFOs are next half empty, so a halt request
+// is not held up. Called with interrupts disabled. The GPIO backend already runs on every step.
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::kick(void) {
+    if ((this->backend != BACKEND_PIO) || (this->step_alarm <= 0)) {
+        return;
+    }
+    alarm_pool_cancel_alarm(this->pool, this->step_alarm);
+    this->step_alarm = alarm_pool_add_alarm_in_us(this->pool, 1, alarm_callback, this, true);
+    if (this->step_alarm < 0) {
+        this->step_alarm = 0;
+    }
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::stop(void) {
+    return(request(HALT_STOP));
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::pause(void) {
+    return(request(HALT_PAUSE));
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::abort(void) {
+    uint32_t irq;
+    int i;
+
+    irq = save_and_disable_interrupts();
+    this->halt_at = to_us_since_boot(get_absolute_time());
+    if (!this->running) {
+        for (i=0; i<N; i++) {
+            this->dropped[i] = 0;
+        }
+        restore_interrupts(irq);
+        return(true);
+    }
+    if (this->step_alarm > 0) {
+        alarm_pool_cancel_alarm(this->pool, this->step_alarm);
+    }
+    if (this->backend == BACKEND_PIO) {
+        for (i=0; i<N; i++) {
+            rewind(i, this->seq[i].flush());
+        }
+    }
+    if (this->planner != NULL) {
+        this->planner->clear();
+        this->planner->next(); // drops the move being executed as well
+    }
+    for (i=0; i<N; i++) {
+        this->jog_vel[i] = 0;
+        this->jog_tgt[i] = 0;
+    }
+    this->jog_on = false;
+    this->steps_left = 0;
+    this->halt_req = HALT_NONE;
+    this->pausing = false;
+    this->is_paused = false;
+    this->hold_left = 0;
+    this->tail_queued = false;
+    this->last_step_us_time = to_us_since_boot(get_absolute_time());
+    finish();
+    restore_interrupts(irq);
+    return(true);
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::resume(void) {
+    uint32_t irq;
+
+    irq = save_and_disable_interrupts();
+    if (!this->is_paused) {
+        restore_interrupts(irq);
+        return(!this->pausing && (this->halt_req == HALT_NONE));
+    }
+    this->is_paused = false;
+    if (this->hold_left > 0) {
+        // carry on with the current move, accelerating from rest
+        this->steps_left = this->hold_left;
+        this->hold_left = 0;
+        this->resume_at = this->steps_total - this->steps_left;
+        this->entry_k = 0;
+        this->exit_k = (this->seg != NULL) ? this->seg->exit : 0;
+        this->exit_fixed = (this->seg == NULL);
+    } else {
+        this->exit_k = 0; // paused between moves
+        if (!loadNext()) {
+            finish();
+            restore_interrupts(irq);
+            return(true);
+        }
+    }
+    restore_interrupts(irq);
+    return(start());
+}
+
+template <uint16_t... CHANS>
+bool SMotGroup<CHANS...>::paused(void) {
+    return(this->is_paused);
+}
+
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::remaining(int idx) {
+    if (this->is_paused) {
+        return((this->end_pos[idx] - this->abs_pos[idx]) / drive_stride(this->drive));
+    }
+    return(this->dropped[idx] / drive_stride(this->drive));
+}
+
+template <uint16_t... CHANS>
+uint64_t SMotGroup<CHANS...>::halted(void) {
+    uint64_t t;
+
+    do {
+        t = this->halt_at;
+    } while (t != this->halt_at);
+    return(t);
+}
+
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::idleTimeout(uint32_t ms) {
+    this->idle_ms = ms;
+}
+
+template <uint16_t... CHANS>
+uint64_t SMotGroup<CHANS...>::energized(void) {
+    uint64_t t;
+    uint64_t since;
+    bool on;
+
+    // updated from the alarms, possibly on the other core, so read until nothing changed in between
+    do {
+        t = this->on_us;
+        on = this->coils_on;
+        since = this->on_since;
+    } while ((t != this->on_us) || (on != this->coils_on) || (since != this->on_since));
+    if (on) {
+        t += to_us_since_boot(get_absolute_time()) - since;
+    }
+    return(t / 1000);
+}
+
+template <uint16_t... CHANS>
+int64_t SMotGroup<CHANS...>::off_callback(alarm_id_t id, void* user_data) {
+    SMotGroup<CHANS...>* group = (SMotGroup<CHANS...>*)user_data;
+
+    group->off_alarm = 0;
+    if (!group->running) { // nothing new arrived while the coils were held
+        group->powerDown();
+    }
+    return(0);
+}
+
+// powerUp: called as a move starts, after running is set, so that a pending power down no longer applies
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::powerUp(void) {
+    if (this->pool == NULL) {
+        this->pool = alarm_pool_get_default();
+    }
+    if (this->off_alarm > 0) {
+        alarm_pool_cancel_alarm(this->pool, this->off_alarm);
+        this->off_alarm = 0;
+    }
+    if (!this->coils_on) {
+        this->on_since = to_us_since_boot(get_absolute_time());
+        this->coils_on = true;
+    }
+}
+
+// powerDown: switch the coils off, only while no move is running
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::powerDown(void) {
+    int i;
+
+    if (this->backend == BACKEND_PIO) {
+        for (i=0; i<N; i++) {
+            putWord(i, 0, STEPSTREAM_MIN_TICKS); // the state machines own the pins
+        }
+    } else {
+        gpio_clr_mask(this->coil_mask);
+    }
+    if (this->coils_on) {
+        this->on_us += to_us_since_boot(get_absolute_time()) - this->on_since;
+        this->coils_on = false;
+    }
+}
+
+// toUs: whole microseconds for an interval in 1/256 microseconds. The fraction left over is carried into
+// the next interval, so the average step rate is exact. Only shifts and adds, this runs for every step.
+template <uint16_t... CHANS>
+inline uint32_t SMotGroup<CHANS...>::toUs(uint32_t interval) {
+    uint32_t us;
+
+    this->frac += interval;
+    us = this->frac >> RAMP_FRAC_BITS;
+    this->frac &= (1UL << RAMP_FRAC_BITS) - 1;
+    if (us == 0) {
+        us = 1; // an alarm cannot be rescheduled for no time at all
+    }
+    return(us);
+}
+
+// stepMotors: drive the coils of all the motors for their current phases in a single write
+template <uint16_t... CHANS>
+void SMotGroup<CHANS...>::stepMotors(void) {
+    uint32_t levels = 0;
+    int i;
+
+    for (i=0; i<N; i++) {
+        levels |= chan_masks[this->chan[i]].phase[this->phase[i]];
+    }
+    gpio_put_masked(this->coil_mask, levels);
+}
+
+#endif // __SMOTGROUP_H_FILE__
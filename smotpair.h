@@ -2,42 +2,294 @@
 #define __SMOTPAIR_H_FILE__
 
 #include "pico/stdlib.h"
+#include "smotgroup.h"
+#include "fixtrig.h"
 
 #define PAIR_FWD 1
 #define PAIR_REV 0
 #define PAIR_LEFT 2
 #define PAIR_RIGHT 3
+#define PAIR_ARC 4
+#define PAIR_JOG 5
+#define PAIR_GOTO 6
 
-class SMotPair {
+// pi as a fraction (355/113 is good to better than 1 part per million), so arcs need no floating point
+#define ARC_PI_NUM 355
+#define ARC_PI_DEN 113
+// fraction bits of the steps per degree given to turnScale()
+#define PAIR_TURN_FIX_BITS 16
+// fraction bits of the pose position, so that the small moves between odometry updates are not lost
+#define PAIR_POSE_FIX_BITS 16
+static_assert((1L << PAIR_POSE_FIX_BITS) == FIXTRIG_ONE, "the pose has the fraction bits of the fixed point sines");
+
+// A pair of wheel motors on channels CHAN1 and CHAN2 (1-4), the two motor case of SMotGroup (see
+// smotgroup.h for speed, mode, profile, accel, usePlanner, ready, busy and onDone)
+template <uint16_t CHAN1, uint16_t CHAN2>
+class SMotPair : public SMotGroup<CHAN1, CHAN2> {
     public:
-        // SMot constructor
-        // parameters: chan1 and chan2 are 1-4 (up to 4 stepper motors are supported)
-        //             steps is number of steps necessary for 360 degrees revolution,
+        // SMotPair constructor, e.g. SMotPair<1, 2> wheels(1000);
+        // parameters: steps is number of steps necessary for 360 degrees revolution,
         //                 it is dependant on the motor and any gearing attached.
         //             psave determines if the motor current is switched off after motion
         //                 (defaults to 1, i.e. save power)
-        SMotPair (uint16_t chan1, uint16_t chan2, uint16_t numsteps, int psave = 1);
-        // Set speed; larger number is faster.
-        void speed(long speed);
-        // Move motor by n steps (direction is 0,1,2,3 (0=fwd, 1=rev, 2=left, 3=right))
-        // The first motor in the pair rotates CCW, and the second motor rotates CW, when viewed from the shaft end,
-        // therefore the first motor in the pair should be attached to the left side of the robot chassis, when viewed
-        // from the rear of the robot.
-        void step(int n, int direction);
+        //             backend is BACKEND_GPIO or BACKEND_PIO (see stepseq.h), if the PIO cannot be
+        //                 used then the motors fall back to GPIO
+        SMotPair (uint16_t numsteps, int psave = 1, int backend = BACKEND_GPIO);
+        // Start moving motor by n steps (direction is 0,1,2,3 (0=rev, 1=fwd, 2=left, 3=right), as PAIR_REV/FWD/LEFT/RIGHT)
+        // To drive forward the first motor in the pair rotates CW, and the second motor rotates CCW, when viewed from
+        // the shaft end, therefore the first motor in the pair should be attached to the right side of the robot
+        // chassis, when viewed from the rear of the robot.
+        // Returns immediately, the steps are issued from a timer alarm. Returns false if a move is already in progress.
+        bool step(int n, int direction);
+        // Move the left (second) and right (first) wheels by different numbers of steps, positive drives that
+        // side of the robot forward. Both motors update together on each tick, and the one with fewer steps
+        // is spread evenly over the move (Bresenham), so they start and finish at the same time.
+        // The speed applies to the motor with the most steps. Returns false if a move is already in progress.
+        bool move(int left, int right);
+        using SMotGroup<CHAN1, CHAN2>::move;
+        // Set half the distance between the wheels, in wheel steps (WHEELSTEPSDEGREE * 180 / pi), used by arc()
+        void track(long half_track);
+        // Set the wheel steps to rotate the robot by 1 degree, as a fixed point number with PAIR_TURN_FIX_BITS
+        // fraction bits (WHEELSTEPSDEGREE * 65536), used by turn()
+        void turnScale(int32_t steps_deg);
+        // Rotate the robot on the spot by mdeg thousandths of a degree, positive turns left. The part of a step
+        // lost to rounding is carried to the next turn, so a series of turns does not drift.
+        // Returns false if a move is already in progress, or if no turn scale has been set.
+        bool turn(long mdeg);
+        // Drive around an arc as one continuous move. The radius is in wheel steps, measured to the centre of the
+        // robot, and the angle is in thousandths of a degree. A positive angle turns left and a negative angle turns right,
+        // a negative radius drives the arc in reverse. A radius smaller than the half track turns one wheel backwards.
+        // Returns false if a move is already in progress, or if no track has been set.
+        bool arc(long radius, long angle);
+        // Drive the left and right wheels continuously at left and right rpm, positive drives that side of the
+        // robot forward. Send new speeds at least once per deadman time to keep moving (see SMotGroup::jog).
+        bool jog(long left, long right);
+        using SMotGroup<CHAN1, CHAN2>::jog;
+        // Update the pose from the steps the wheels have made since the last call. The heading follows from the
+        // difference between the wheel positions and the turn scale, and the position of the centre of the robot
+        // is advanced along the mean heading of each update. Call it often from the core that runs the steps,
+        // e.g. on every pass of its main loop. Nothing is tracked until turnScale() is set.
+        void odometry(void);
+        // Pose of the robot: x and y in wheel steps from where it started (rounded), and the heading in
+        // milli-degrees from -179999 to 180000, positive is anticlockwise. It starts at 0, 0 facing along x.
+        // Can be called from either core.
+        void pose(int64_t* x, int64_t* y, int32_t* heading);
+        // Turn towards x, y (in the units of pose()) and drive straight to it. The turn and the drive are
+        // planned from the pose, so this waits for the wheels to be at rest: returns false if a move is in
+        // progress, or if no turn scale has been set.
+        bool moveTo(long x, long y);
 
     private:
-        void stepMotor(int chan, int step);
-        int dir[2];
-        unsigned long delay;
-        int steps360; // number of steps for 360 degree revolution
-        int stepcount[2];
-        int pin1[2];
-        int pin2[2];
-        int pin3[2];
-        int pin4[2];
-        int powersave;
-
-        unsigned long last_step_us_time;
+        static int arc_steps(int64_t radius, int64_t angle);
+        long half_track; // half the wheel separation, in wheel steps
+        int32_t turn_scale; // wheel steps per degree, with PAIR_TURN_FIX_BITS fraction bits
+        int64_t turn_carry; // rounding left over from the last turn, in the units of mdeg * turn_scale
+        int64_t odo_pos[2]; // right and left wheel positions at the last odometry update, positive is forward
+        int64_t pose_x; // position of the centre of the robot, in steps with PAIR_POSE_FIX_BITS fraction bits
+        int64_t pose_y;
+        int32_t pose_heading; // milli-degrees, positive is anticlockwise
+        volatile uint32_t pose_seq; // odd while odometry() is updating the pose
 };
 
+template <uint16_t CHAN1, uint16_t CHAN2>
+SMotPair<CHAN1, CHAN2>::SMotPair(uint16_t numsteps, int psave, int backend)
+    : SMotGroup<CHAN1, CHAN2>(numsteps, psave, backend) {
+    this->half_track = 0;
+    this->turn_scale = 0;
+    this->turn_carry = 0;
+    this->odo_pos[0] = 0;
+    this->odo_pos[1] = 0;
+    this->pose_x = 0;
+    this->pose_y = 0;
+    this->pose_heading = 0;
+    this->pose_seq = 0;
+    this->speed(100); // default speed is 100
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+bool SMotPair<CHAN1, CHAN2>::step(int n, int direction) {
+    if (n <= 0) {
+        return(!this->busy());
+    }
+    switch(direction) {
+        case 0: // rev
+            return(move(0 - n, 0 - n));
+        case 1: // fwd
+            return(move(n, n));
+        case 2: // left
+            return(move(0 - n, n));
+        case 3: // right
+            return(move(n, 0 - n));
+        default:
+            break;
+    }
+    return(false);
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+bool SMotPair<CHAN1, CHAN2>::move(int left, int right) {
+    int steps[2];
+
+    // the first motor drives the right wheel and rotates CW (direction 1) for forward,
+    // the second drives the left wheel and rotates CCW (direction 0) for forward
+    steps[0] = right;
+    steps[1] = 0 - left;
+    return(SMotGroup<CHAN1, CHAN2>::move(steps));
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+bool SMotPair<CHAN1, CHAN2>::jog(long left, long right) {
+    long rpm[2];
+
+    // the same directions as move()
+    rpm[0] = right;
+    rpm[1] = 0 - left;
+    return(SMotGroup<CHAN1, CHAN2>::jog(rpm));
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+void SMotPair<CHAN1, CHAN2>::track(long half_track) {
+    this->half_track = half_track;
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+void SMotPair<CHAN1, CHAN2>::turnScale(int32_t steps_deg) {
+    this->turn_scale = steps_deg;
+    this->turn_carry = 0;
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+bool SMotPair<CHAN1, CHAN2>::turn(long mdeg) {
+    const int64_t den = (int64_t)1000 << PAIR_TURN_FIX_BITS; // mdeg * turn_scale / den is in steps
+    int64_t total;
+    int64_t n;
+
+    if (this->turn_scale <= 0) {
+        printf("error, turn scale not set!\n");
+        return(false);
+    }
+    total = (int64_t)mdeg * this->turn_scale + this->turn_carry;
+    // rounded to the nearest step, halves away from zero as in arc_steps()
+    if (total < 0) {
+        n = 0 - ((den / 2 - total) / den);
+    } else {
+        n = (total + den / 2) / den;
+    }
+    if (n != 0) {
+        if (!move((int)(0 - n), (int)n)) {
+            return(false); // the carry is kept for the turn that is sent again
+        }
+    }
+    this->turn_carry = total - n * den;
+    return(true);
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+void SMotPair<CHAN1, CHAN2>::odometry(void) {
+    int64_t right = this->position(0);
+    int64_t left = 0 - this->position(1);
+    int64_t travel;
+    int32_t heading;
+    int32_t mid;
+
+    if ((this->turn_scale <= 0) || ((right == this->odo_pos[0]) && (left == this->odo_pos[1]))) {
+        return;
+    }
+    // a turn of mdeg moves the wheels mdeg * turn_scale / (1000 << PAIR_TURN_FIX_BITS) steps each way (see turn())
+    heading = fix_wrap((right - left) * (500LL << PAIR_TURN_FIX_BITS) / this->turn_scale);
+    mid = fix_wrap(this->pose_heading + fix_wrap((int64_t)heading - this->pose_heading) / 2);
+    // twice the travel of the centre of the robot, in steps
+    travel = (right - this->odo_pos[0]) + (left - this->odo_pos[1]);
+    this->pose_seq++;
+    __dmb();
+    this->pose_x += travel * fix_cos(mid) / 2; // the Q16 sines give PAIR_POSE_FIX_BITS fraction bits
+    this->pose_y += travel * fix_sin(mid) / 2;
+    this->pose_heading = heading;
+    __dmb();
+    this->pose_seq++;
+    this->odo_pos[0] = right;
+    this->odo_pos[1] = left;
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+void SMotPair<CHAN1, CHAN2>::pose(int64_t* x, int64_t* y, int32_t* heading) {
+    uint32_t seq;
+    int64_t px;
+    int64_t py;
+
+    // read again if odometry() updated the pose meanwhile (it runs on the other core)
+    do {
+        seq = this->pose_seq;
+        __dmb();
+        px = this->pose_x;
+        py = this->pose_y;
+        *heading = this->pose_heading;
+        __dmb();
+    } while ((seq & 1) || (seq != this->pose_seq));
+    *x = (px + (1LL << (PAIR_POSE_FIX_BITS - 1))) >> PAIR_POSE_FIX_BITS;
+    *y = (py + (1LL << (PAIR_POSE_FIX_BITS - 1))) >> PAIR_POSE_FIX_BITS;
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+bool SMotPair<CHAN1, CHAN2>::moveTo(long x, long y) {
+    int64_t dx;
+    int64_t dy;
+    int64_t dist;
+
+    if (this->turn_scale <= 0) {
+        printf("error, turn scale not set!\n");
+        return(false);
+    }
+    if (this->busy()) {
+        return(false);
+    }
+    this->odometry(); // the wheels are at rest, so the pose is where they are
+    dx = ((int64_t)x << PAIR_POSE_FIX_BITS) - this->pose_x;
+    dy = ((int64_t)y << PAIR_POSE_FIX_BITS) - this->pose_y;
+    dist = fix_hypot((dx + (1LL << (PAIR_POSE_FIX_BITS - 1))) >> PAIR_POSE_FIX_BITS,
+                     (dy + (1LL << (PAIR_POSE_FIX_BITS - 1))) >> PAIR_POSE_FIX_BITS);
+    if (dist == 0) {
+        return(true); // already there, the heading is kept
+    }
+    if (!turn(fix_wrap((int64_t)fix_atan2(dy, dx) - this->pose_heading))) {
+        return(false);
+    }
+    return(step((int)dist, PAIR_FWD));
+}
+
+// arc_steps: wheel travel in steps for a path of the given radius swept through angle milli-degrees,
+// rounded to nearest
+template <uint16_t CHAN1, uint16_t CHAN2>
+int SMotPair<CHAN1, CHAN2>::arc_steps(int64_t radius, int64_t angle) {
+    int64_t num = radius * angle * ARC_PI_NUM;
+    int64_t den = 180000 * ARC_PI_DEN;
+
+    if (num < 0) {
+        return((int)(0 - ((den / 2 - num) / den)));
+    }
+    return((int)((num + den / 2) / den));
+}
+
+template <uint16_t CHAN1, uint16_t CHAN2>
+bool SMotPair<CHAN1, CHAN2>::arc(long radius, long angle) {
+    int inner;
+    int outer;
+
+    if (this->half_track <= 0) {
+        printf("error, track not set!\n");
+        return(false);
+    }
+    // the inner wheel follows radius - half_track, the outer one radius + half_track
+    inner = arc_steps(abs(radius) - this->half_track, abs(angle));
+    outer = arc_steps(abs(radius) + this->half_track, abs(angle));
+    if (radius < 0) {
+        inner = 0 - inner;
+        outer = 0 - outer;
+    }
+    if (angle >= 0) {
+        return(move(inner, outer)); // turning left, the left wheel is on the inside
+    }
+    return(move(outer, inner));
+}
+
 #endif // __SMOTPAIR_H_FILE__
@@ -0,0 +1,93 @@
+#ifndef __SMOTPINS_H_FILE__
+#define __SMOTPINS_H_FILE__
+
+// smotpins.h
+// Stepper channel pin mapping and coil phase tables, all resolved at compile time.
+// This file has no Pico SDK dependencies.
+
+#include <stdint.h>
+
+// drive modes
+#define DRIVE_FULL 0 // two coils on, full steps (highest torque)
+#define DRIVE_HALF 1 // alternately one and two coils on, half steps (double resolution)
+#define DRIVE_WAVE 2 // one coil on, full steps (lowest current)
+
+#define SMOT_NUM_CHANS 4
+#define SMOT_NUM_PHASES 8
+
+// coil pins (pin1, pin2, pin3, pin4) of channels 1-4, channel 0 is invalid and drives nothing
+constexpr uint8_t chan_pins[SMOT_NUM_CHANS + 1][4] = {
+    {0, 0, 0, 0},
+    {7, 6, 2, 3},
+    {11, 10, 8, 9},
+    {15, 14, 12, 13},
+    {16, 17, 19, 18}
+};
+
+// coil patterns for the eight half-step states, bit 0 is pin1 and bit 3 is pin4.
+// The even states are the full-step states (1010, 0110, 0101, 1001 on pin1..pin4),
+// the odd states have a single coil on and make up the wave drive sequence.
+constexpr uint8_t halfstep_pattern[SMOT_NUM_PHASES] = {0x05, 0x04, 0x06, 0x02, 0x0a, 0x08, 0x09, 0x01};
+
+// GPIO masks for one channel: all four coil pins, and the pins to set high in each half-step state
+struct ChanMasks {
+    uint32_t all;
+    uint32_t phase[SMOT_NUM_PHASES];
+};
+
+constexpr uint32_t chan_coils(int chan, int pattern) {
+    uint32_t mask = 0;
+    for (int j = 0; j < 4; j++) {
+        if ((chan > 0) && (pattern & (1 << j))) {
+            mask |= 1UL << chan_pins[chan][j];
+        }
+    }
+    return(mask);
+}
+
+constexpr ChanMasks make_chan_masks(int chan) {
+    ChanMasks m = {};
+    m.all = chan_coils(chan, 0x0f);
+    for (int k = 0; k < SMOT_NUM_PHASES; k++) {
+        m.phase[k] = chan_coils(chan, halfstep_pattern[k]);
+    }
+    return(m);
+}
+
+constexpr ChanMasks chan_masks[SMOT_NUM_CHANS + 1] = {
+    make_chan_masks(0),
+    make_chan_masks(1),
+    make_chan_masks(2),
+    make_chan_masks(3),
+    make_chan_masks(4)
+};
+
+// compile-time descriptor of channel CHAN (1-4), anything else fails to compile
+template <uint16_t CHAN>
+struct SMotChan {
+    static_assert((CHAN >= 1) && (CHAN <= SMOT_NUM_CHANS), "invalid stepper channel, must be 1-4");
+    static constexpr const uint8_t* pins = chan_pins[CHAN];
+    static constexpr uint32_t mask = chan_masks[CHAN].all;
+};
+
+// true if no two of the coil masks share a pin
+constexpr bool chans_distinct(void) {
+    return(true);
+}
+
+template <typename... MASKS>
+constexpr bool chans_distinct(uint32_t mask, MASKS... rest) {
+    return((((rest & mask) == 0) && ...) && chans_distinct(rest...));
+}
+
+// change of half-step state per step in each drive mode
+constexpr int drive_stride(int mode) {
+    return((mode == DRIVE_HALF) ? 1 : 2);
+}
+
+// half-step state to start a move from: full steps use the even states and wave drive the odd ones
+constexpr int drive_phase(int mode, int phase) {
+    return((mode == DRIVE_FULL) ? (phase & ~1) : ((mode == DRIVE_WAVE) ? (phase | 1) : phase));
+}
+
+#endif // __SMOTPINS_H_FILE__
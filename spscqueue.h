@@ -0,0 +1,99 @@
+#ifndef __SPSCQUEUE_H_FILE__
+#define __SPSCQUEUE_H_FILE__
+
+// spscqueue.h
+// Fixed capacity single-producer single-consumer queue, nothing is allocated. The producer only writes
+// the head count and the consumer only writes the tail count, so neither has to lock the other out:
+// an interrupt handler can add items while the main loop takes them, or one core can feed the other.
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+template <typename T, uint32_t LEN>
+class SpscQueue {
+    static_assert((LEN > 0) && ((LEN & (LEN - 1)) == 0), "the queue length must be a power of 2");
+
+    public:
+        SpscQueue();
+        // Producer: copy item to the back of the queue. Returns false if the queue is full.
+        bool push(const T& item);
+        // Consumer: the item at the front of the queue, or NULL if it is empty. The item stays valid,
+        // and stays in the queue, until pop() is called.
+        T* peek(void);
+        // Consumer: remove the item at the front of the queue
+        void pop(void);
+        // Returns true if there is nothing in the queue
+        bool empty(void);
+        // Returns true if push() would fail
+        bool full(void);
+        // Count of items pushed so far, and of items popped so far. The counts wrap, compare them by difference.
+        uint32_t pushed(void);
+        uint32_t popped(void);
+
+    private:
+        T mSlots[LEN];
+        volatile uint32_t mHead; // count of items pushed
+        volatile uint32_t mTail; // count of items popped
+};
+
+template <typename T, uint32_t LEN>
+SpscQueue<T, LEN>::SpscQueue() {
+    mHead = 0;
+    mTail = 0;
+}
+
+template <typename T, uint32_t LEN>
+bool SpscQueue<T, LEN>::push(const T& item) {
+    uint32_t head = mHead;
+
+    if ((head - mTail) >= LEN) {
+        return(false);
+    }
+    mSlots[head & (LEN - 1)] = item;
+    __dmb(); // the item must be written before the consumer can see it
+    mHead = head + 1;
+    return(true);
+}
+
+template <typename T, uint32_t LEN>
+T* SpscQueue<T, LEN>::peek(void) {
+    uint32_t tail = mTail;
+
+    if (tail == mHead) {
+        return(NULL);
+    }
+    __dmb(); // read the item only after seeing the head count that published it
+    return(&mSlots[tail & (LEN - 1)]);
+}
+
+template <typename T, uint32_t LEN>
+void SpscQueue<T, LEN>::pop(void) {
+    uint32_t tail = mTail;
+
+    if (tail != mHead) {
+        __dmb(); // finish with the item before the producer can reuse its slot
+        mTail = tail + 1;
+    }
+}
+
+template <typename T, uint32_t LEN>
+bool SpscQueue<T, LEN>::empty(void) {
+    return(mHead == mTail);
+}
+
+template <typename T, uint32_t LEN>
+bool SpscQueue<T, LEN>::full(void) {
+    return((mHead - mTail) >= LEN);
+}
+
+template <typename T, uint32_t LEN>
+uint32_t SpscQueue<T, LEN>::pushed(void) {
+    return(mHead);
+}
+
+template <typename T, uint32_t LEN>
+uint32_t SpscQueue<T, LEN>::popped(void) {
+    return(mTail);
+}
+
+#endif // __SPSCQUEUE_H_FILE__
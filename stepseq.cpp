@@ -0,0 +1,95 @@
+/******************************************************
+ * stepseq.cpp
+ * PIO Stepper Phase Sequencer
+ * ****************************************************/
+
+#include "stepseq.h"
+#include "hardware/clocks.h"
+#include "stepseq.pio.h"
+#include "stdio.h"
+
+int StepSeq::mOffset = -1;
+
+StepSeq::StepSeq() {
+    int i;
+
+    mPio = pio0;
+    mSm = 0;
+    for (i=0; i<4; i++) {
+        mPins[i] = 0;
+    }
+}
+
+bool StepSeq::init(int p1, int p2, int p3, int p4) {
+    int sm;
+    int i;
+
+    mMap = StepStream(p1, p2, p3, p4);
+    if (!mMap.valid()) {
+        printf("error, pins too far apart for PIO!\n");
+        return(false);
+    }
+    if (mOffset < 0) {
+        if (!pio_can_add_program(mPio, &stepseq_program)) {
+            printf("error, no PIO program space!\n");
+            return(false);
+        }
+        mOffset = pio_add_program(mPio, &stepseq_program);
+    }
+    sm = pio_claim_unused_sm(mPio, false);
+    if (sm < 0) {
+        printf("error, no free PIO state machine!\n");
+        return(false);
+    }
+    mSm = (uint)sm;
+    mPins[0] = p1;
+    mPins[1] = p2;
+    mPins[2] = p3;
+    mPins[3] = p4;
+    // only the coil pins are handed to the PIO, other pins within the span are left alone
+    for (i=0; i<4; i++) {
+        pio_gpio_init(mPio, mPins[i]);
+    }
+    stepseq_program_init(mPio, mSm, mOffset, mMap.base(), mMap.count(), STEPSEQ_TICK_HZ);
+    return(true);
+}
+
+bool __not_in_flash_func(StepSeq::put)(int pattern, uint32_t us) {
+    int n = StepStream::words(us);
+    int k;
+
+    if (n == 1) {
+        if (pio_sm_is_tx_fifo_full(mPio, mSm)) {
+            return(false);
+        }
+        pio_sm_put(mPio, mSm, mMap.encode(pattern, us));
+        return(true);
+    }
+    if (space() < n) {
+        return(false);
+    }
+    for (k=0; k<n; k++) {
+        pio_sm_put(mPio, mSm, mMap.encodePart(pattern, us, k));
+    }
+    return(true);
+}
+
+int __not_in_flash_func(StepSeq::space)(void) {
+    return(STEPSEQ_FIFO_DEPTH - pio_sm_get_tx_fifo_level(mPio, mSm));
+}
+
+bool __not_in_flash_func(StepSeq::idle)(void) {
+    // the state machine is idle when it is sitting on the pull instruction with nothing left to pull
+    return(pio_sm_is_tx_fifo_empty(mPio, mSm) && (pio_sm_get_pc(mPio, mSm) == (uint)mOffset));
+}
+
+int StepSeq::flush(void) {
+    int level;
+
+    // stop the state machine so that it cannot pull a word between reading the level and clearing
+    pio_sm_set_enabled(mPio, mSm, false);
+    level = pio_sm_get_tx_fifo_level(mPio, mSm);
+    pio_sm_clear_fifos(mPio, mSm);
+    pio_sm_set_enabled(mPio, mSm, true);
+    return(level);
+}
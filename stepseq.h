@@ -0,0 +1,43 @@
+#ifndef __STEPSEQ_H_FILE__
+#define __STEPSEQ_H_FILE__
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "stepstream.h"
+
+// step output backends, selected when a motor object is constructed
+#define BACKEND_GPIO 0 // coil pins are written with gpio_put from the step alarm
+#define BACKEND_PIO 1 // coil pins are driven by a PIO state machine, the step alarm only refills its FIFO
+
+// PIO clock rate, one tick is one microsecond so the hold times are the step delays
+#define STEPSEQ_TICK_HZ 1000000
+// depth of the (joined) TX FIFO
+#define STEPSEQ_FIFO_DEPTH 8
+
+class StepSeq {
+    public:
+        StepSeq();
+        // Claim a state machine on pio0 and hand the coil pins p1-p4 over to it.
+        // Returns false if the pins cannot be driven by one state machine or none is free.
+        bool init(int p1, int p2, int p3, int p4);
+        // Queue a coil pattern (bit 0 is pin1, bit 3 is pin4) to be held for us microseconds. A hold
+        // longer than one word is split over StepStream::words(us) words. Returns false if the FIFO
+        // does not have room for them all.
+        bool put(int pattern, uint32_t us);
+        // Number of words that can be queued without blocking
+        int space(void);
+        // Returns true once all the queued words have been played out
+        bool idle(void);
+        // Discard the words waiting in the FIFO, the word being played is finished as normal.
+        // Returns the number of words discarded.
+        int flush(void);
+
+    private:
+        static int mOffset; // program offset in pio0, loaded by the first StepSeq to be initialized
+        PIO mPio;
+        uint mSm;
+        StepStream mMap;
+        int mPins[4];
+};
+
+#endif // __STEPSEQ_H_FILE__
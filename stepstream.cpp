@@ -0,0 +1,112 @@
+/******************************************************
+ * stepstream.cpp
+ * Step word encoding for the stepseq PIO program
+ * ****************************************************/
+
+#include "stepstream.h"
+
+StepStream::StepStream(int p1, int p2, int p3, int p4) {
+    int pins[4] = {p1, p2, p3, p4};
+    int lo = pins[0];
+    int hi = pins[0];
+    int i;
+
+    for (i=1; i<4; i++) {
+        if (pins[i] < lo) lo = pins[i];
+        if (pins[i] > hi) hi = pins[i];
+    }
+    mBase = (uint8_t)lo;
+    mCount = (uint8_t)(hi - lo + 1);
+    for (i=0; i<4; i++) {
+        mShift[i] = (uint8_t)(pins[i] - lo);
+    }
+}
+
+bool StepStream::valid(void) {
+    return(mCount <= STEPSTREAM_PIN_BITS);
+}
+
+int StepStream::base(void) {
+    return(mBase);
+}
+
+int StepStream::count(void) {
+    return(mCount);
+}
+
+uint32_t StepStream::encode(int pattern, uint32_t ticks) {
+    uint32_t word = 0;
+    int i;
+
+    for (i=0; i<4; i++) {
+        if (pattern & (1 << i)) {
+            word |= 1UL << mShift[i];
+        }
+    }
+    if (ticks < STEPSTREAM_MIN_TICKS) {
+        ticks = STEPSTREAM_MIN_TICKS;
+    }
+    if (ticks > STEPSTREAM_MAX_TICKS) {
+        ticks = STEPSTREAM_MAX_TICKS;
+    }
+    word |= (ticks - STEPSTREAM_MIN_TICKS) << STEPSTREAM_PIN_BITS;
+    return(word);
+}
+
+int StepStream::words(uint32_t ticks) {
+    if (ticks <= STEPSTREAM_MAX_TICKS) {
+        return(1);
+    }
+    return((int)((ticks - 1) / STEPSTREAM_MAX_TICKS) + 1);
+}
+
+uint32_t StepStream::encodePart(int pattern, uint32_t ticks, int part) {
+    uint32_t n = (uint32_t)words(ticks);
+
+    // the ticks are shared out evenly, so no part is shorter than half a word
+    return(encode(pattern, ticks / n + (((uint32_t)part < ticks % n) ? 1 : 0)));
+}
+
+int StepStream::pattern(uint32_t word) {
+    int pattern = 0;
+    int i;
+
+    for (i=0; i<4; i++) {
+        if (word & (1UL << mShift[i])) {
+            pattern |= 1 << i;
+        }
+    }
+    return(pattern);
+}
+
+uint32_t StepStream::ticks(uint32_t word) {
+    return((word >> STEPSTREAM_PIN_BITS) + STEPSTREAM_MIN_TICKS);
+}
+
+StepStreamModel::StepStreamModel(const StepStream& map) : mMap(map) {
+    mPins = 0;
+    mTicks = 0;
+}
+
+uint32_t StepStreamModel::exec(uint32_t word) {
+    uint32_t t;
+
+    // out pins: only the pins in the out pin mapping are written
+    mPins = word & ((1UL << mMap.count()) - 1);
+    // pull + out + out, then jmp x-- runs x+1 times
+    t = StepStream::ticks(word);
+    mTicks += t;
+    return(t);
+}
+
+int StepStreamModel::pattern(void) {
+    return(mMap.pattern(mPins));
+}
+
+uint32_t StepStreamModel::gpio(void) {
+    return(mPins << mMap.base());
+}
+
+uint64_t StepStreamModel::elapsed(void) {
+    return(mTicks);
+}
@@ -0,0 +1,69 @@
+#ifndef __STEPSTREAM_H_FILE__
+#define __STEPSTREAM_H_FILE__
+
+// stepstream.h
+// Encoding of the step word stream consumed by the stepseq PIO program (see stepseq.pio).
+// This file has no Pico SDK dependencies, so the encoding can be checked on a host PC.
+//
+// Each 32-bit word drives one coil pattern and then holds it:
+//   bits 0-7:  levels for up to 8 consecutive GPIO pins, starting at the channel base pin
+//   bits 8-31: hold time in PIO ticks, minus STEPSTREAM_MIN_TICKS (the program overhead)
+// A hold longer than STEPSTREAM_MAX_TICKS is split over several words driving the same pattern.
+// test/test_stepstream.cpp checks the encoding against the model below.
+
+#include <stdint.h>
+
+#define STEPSTREAM_PIN_BITS 8
+#define STEPSTREAM_TICK_BITS 24
+// pull + out + out + the final jmp, i.e. the shortest time a word can take
+#define STEPSTREAM_MIN_TICKS 4
+#define STEPSTREAM_MAX_TICKS ((1UL << STEPSTREAM_TICK_BITS) - 1 + STEPSTREAM_MIN_TICKS)
+
+class StepStream {
+    public:
+        // StepStream constructor
+        // parameters: p1-p4 are the GPIO numbers of the pin1-pin4 coil outputs of a channel
+        StepStream(int p1 = 0, int p2 = 0, int p3 = 0, int p4 = 0);
+        // Returns true if the pins fit within the 8 consecutive GPIOs a word can drive
+        bool valid(void);
+        // Lowest GPIO number used by the channel, and the number of GPIOs spanned from it
+        int base(void);
+        int count(void);
+        // Build a word that drives pattern (bit 0 is pin1, bit 3 is pin4) for ticks PIO ticks
+        uint32_t encode(int pattern, uint32_t ticks);
+        // Number of words needed to hold a pattern for ticks PIO ticks
+        static int words(uint32_t ticks);
+        // Build word part (0 to words(ticks) - 1) of a hold of ticks PIO ticks. The parts drive the same
+        // pattern and their hold times add up to ticks.
+        uint32_t encodePart(int pattern, uint32_t ticks, int part);
+        // Extract the coil pattern or the hold time from a word
+        int pattern(uint32_t word);
+        static uint32_t ticks(uint32_t word);
+
+    private:
+        uint8_t mBase;
+        uint8_t mCount;
+        uint8_t mShift[4]; // bit position of pin1-pin4 within the word
+};
+
+// Host-side model of the stepseq PIO state machine.
+// Words are executed one at a time; the model tracks the pin levels and the elapsed PIO ticks.
+class StepStreamModel {
+    public:
+        StepStreamModel(const StepStream& map);
+        // Execute one word, returns the number of ticks it took
+        uint32_t exec(uint32_t word);
+        // Coil pattern currently being driven (bit 0 is pin1, bit 3 is pin4)
+        int pattern(void);
+        // GPIO output levels currently being driven, as a 32-bit mask
+        uint32_t gpio(void);
+        // PIO ticks elapsed since the model was created
+        uint64_t elapsed(void);
+
+    private:
+        StepStream mMap;
+        uint32_t mPins;
+        uint64_t mTicks;
+};
+
+#endif // __STEPSTREAM_H_FILE__
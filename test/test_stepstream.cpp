@@ -0,0 +1,114 @@
+/******************************************************
+ * test_stepstream.cpp
+ * Host test of the stepseq word encoding (see stepstream.h)
+ * ****************************************************/
+
+#include "stepstream.h"
+#include "stdio.h"
+
+int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line)
+{
+    if (!ok) {
+        printf("FAIL line %d: %s\n", line, what);
+        failures++;
+    }
+}
+
+// the wheel channels are GPIOs 2-5 and 6-9, and the pins of a channel need not be in order
+void test_packing(void)
+{
+    StepStream map(5, 3, 2, 4);
+    StepStreamModel model(map);
+    uint32_t word;
+    int pattern;
+
+    CHECK(map.valid());
+    CHECK(map.base() == 2);
+    CHECK(map.count() == 4);
+    for (pattern=0; pattern<16; pattern++) {
+        word = map.encode(pattern, 1000);
+        CHECK(map.pattern(word) == pattern);
+        CHECK(StepStream::ticks(word) == 1000);
+        CHECK(model.exec(word) == 1000);
+        CHECK(model.pattern() == pattern);
+        CHECK((model.gpio() & ~(0xfUL << 2)) == 0); // only the channel's pins are driven
+    }
+    // pin1 is GPIO 5, pin4 is GPIO 4
+    model.exec(map.encode(0x1, 10));
+    CHECK(model.gpio() == (1UL << 5));
+    model.exec(map.encode(0x8, 10));
+    CHECK(model.gpio() == (1UL << 4));
+    CHECK(model.elapsed() == 16 * 1000 + 2 * 10);
+    CHECK(!StepStream(0, 1, 2, 8).valid()); // 9 pins apart, more than a word can drive
+}
+
+void test_limits(void)
+{
+    StepStream map(2, 3, 4, 5);
+    uint32_t word;
+
+    // the shortest hold is the program overhead
+    word = map.encode(0x3, 0);
+    CHECK(StepStream::ticks(word) == STEPSTREAM_MIN_TICKS);
+    CHECK((word >> STEPSTREAM_PIN_BITS) == 0);
+    // the largest hold fills the hold field
+    word = map.encode(0x3, STEPSTREAM_MAX_TICKS);
+    CHECK(StepStream::ticks(word) == STEPSTREAM_MAX_TICKS);
+    CHECK((word >> STEPSTREAM_PIN_BITS) == (1UL << STEPSTREAM_TICK_BITS) - 1);
+    CHECK(map.pattern(word) == 0x3);
+    CHECK(StepStream::words(STEPSTREAM_MAX_TICKS) == 1);
+    CHECK(StepStream::words(STEPSTREAM_MAX_TICKS + 1) == 2);
+    // a single word is clamped
+    CHECK(StepStream::ticks(map.encode(0x3, STEPSTREAM_MAX_TICKS + 1)) == STEPSTREAM_MAX_TICKS);
+}
+
+// a hold longer than one word is split, the parts keep the pattern and add up to the hold
+void test_split(void)
+{
+    const uint32_t holds[] = {STEPSTREAM_MAX_TICKS + 1, 2 * STEPSTREAM_MAX_TICKS, 2 * STEPSTREAM_MAX_TICKS + 1,
+                              100000000, 0xffffffffUL};
+    StepStream map(6, 7, 8, 9);
+    uint32_t hold;
+    uint32_t t;
+    uint64_t start;
+    int n;
+    int i;
+    int k;
+
+    for (i=0; i<(int)(sizeof(holds) / sizeof(holds[0])); i++) {
+        StepStreamModel model(map);
+        hold = holds[i];
+        n = StepStream::words(hold);
+        CHECK((uint64_t)n * STEPSTREAM_MAX_TICKS >= hold);
+        CHECK((uint64_t)(n - 1) * STEPSTREAM_MAX_TICKS < hold);
+        model.exec(map.encode(0x9, 100));
+        start = model.elapsed();
+        for (k=0; k<n; k++) {
+            t = model.exec(map.encodePart(0x6, hold, k));
+            CHECK(t <= STEPSTREAM_MAX_TICKS);
+            CHECK(t >= STEPSTREAM_MAX_TICKS / 2);
+            CHECK(model.pattern() == 0x6);
+            CHECK(model.gpio() == (0x6UL << 6));
+        }
+        CHECK(model.elapsed() - start == hold);
+    }
+    // a hold that fits in one word is the same as encode()
+    CHECK(map.encodePart(0x6, 1234, 0) == map.encode(0x6, 1234));
+}
+
+int main(void)
+{
+    test_packing();
+    test_limits();
+    test_split();
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return(1);
+    }
+    printf("stepstream ok\n");
+    return(0);
+}